@@ -23,8 +23,70 @@ BEGIN_RCPP
 END_RCPP
 }
 
+// run_mcmc_batch
+Rcpp::List run_mcmc_batch(Rcpp::List args_list, int num_threads);
+RcppExport SEXP _moire_run_mcmc_batch(SEXP args_listSEXP, SEXP num_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::List >::type args_list(args_listSEXP);
+    Rcpp::traits::input_parameter< int >::type num_threads(num_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(run_mcmc_batch(args_list, num_threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// bench_kernels
+Rcpp::List bench_kernels(Rcpp::List args, int coi, double min_seconds);
+RcppExport SEXP _moire_bench_kernels(SEXP argsSEXP, SEXP coiSEXP, SEXP min_secondsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::List >::type args(argsSEXP);
+    Rcpp::traits::input_parameter< int >::type coi(coiSEXP);
+    Rcpp::traits::input_parameter< double >::type min_seconds(min_secondsSEXP);
+    rcpp_result_gen = Rcpp::wrap(bench_kernels(args, coi, min_seconds));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// simulate_data
+Rcpp::List simulate_data(double mean_coi, std::vector<std::vector<double>> locus_freq_alphas, int num_samples, double epsilon_pos, double epsilon_neg, double seed, int num_threads);
+RcppExport SEXP _moire_simulate_data(SEXP mean_coiSEXP, SEXP locus_freq_alphasSEXP, SEXP num_samplesSEXP, SEXP epsilon_posSEXP, SEXP epsilon_negSEXP, SEXP seedSEXP, SEXP num_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< double >::type mean_coi(mean_coiSEXP);
+    Rcpp::traits::input_parameter< std::vector<std::vector<double>> >::type locus_freq_alphas(locus_freq_alphasSEXP);
+    Rcpp::traits::input_parameter< int >::type num_samples(num_samplesSEXP);
+    Rcpp::traits::input_parameter< double >::type epsilon_pos(epsilon_posSEXP);
+    Rcpp::traits::input_parameter< double >::type epsilon_neg(epsilon_negSEXP);
+    Rcpp::traits::input_parameter< double >::type seed(seedSEXP);
+    Rcpp::traits::input_parameter< int >::type num_threads(num_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(simulate_data(mean_coi, locus_freq_alphas, num_samples, epsilon_pos, epsilon_neg, seed, num_threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// philox_block
+std::vector<std::string> philox_block(std::vector<std::string> counter, std::vector<std::string> key);
+RcppExport SEXP _moire_philox_block(SEXP counterSEXP, SEXP keySEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type counter(counterSEXP);
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type key(keySEXP);
+    rcpp_result_gen = Rcpp::wrap(philox_block(counter, key));
+    return rcpp_result_gen;
+END_RCPP
+}
+
 static const R_CallMethodDef CallEntries[] = {
     {"_moire_run_mcmc", (DL_FUNC) &_moire_run_mcmc, 1},
+    {"_moire_run_mcmc_batch", (DL_FUNC) &_moire_run_mcmc_batch, 2},
+    {"_moire_bench_kernels", (DL_FUNC) &_moire_bench_kernels, 3},
+    {"_moire_simulate_data", (DL_FUNC) &_moire_simulate_data, 7},
+    {"_moire_philox_block", (DL_FUNC) &_moire_philox_block, 2},
     {NULL, NULL, 0}
 };
 
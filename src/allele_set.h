@@ -0,0 +1,130 @@
+#pragma once
+
+#ifndef ALLELE_SET_H_
+#define ALLELE_SET_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Read only view of a genotype at a locus. Dense genotypes are stored one bit
+ * per allele, 64 alleles to a word. Bits past the last allele are always
+ * zero, so counts reduce to popcounts over whole words. Sparse genotypes are
+ * stored as the ascending indices of the alleles present, for loci with so
+ * many alleles that nearly every bit would be zero.
+ */
+class AlleleSet
+{
+   public:
+    using word_t = uint64_t;
+    using index_t = uint16_t;
+    static constexpr int bits_per_word = 64;
+    static constexpr int max_sparse_alleles = UINT16_MAX + 1;
+
+    AlleleSet() = default;
+    AlleleSet(const word_t *words, int num_alleles)
+        : words_(words), num_alleles_(num_alleles){};
+    AlleleSet(const index_t *indices, int num_present, int num_alleles)
+        : indices_(indices), num_present_(num_present),
+          num_alleles_(num_alleles){};
+
+    static int num_words(int num_alleles)
+    {
+        return (num_alleles + bits_per_word - 1) / bits_per_word;
+    }
+
+    static void set(word_t *words, int allele)
+    {
+        words[allele / bits_per_word] |= word_t{1} << (allele % bits_per_word);
+    }
+
+    int size() const { return num_alleles_; }
+    int num_words() const { return num_words(num_alleles_); }
+
+    // a sparse genotype binary searches its indices, loops over alleles
+    // should use for_each or for_all instead
+    int operator[](int allele) const
+    {
+        if (words_ != nullptr)
+        {
+            return (words_[allele / bits_per_word] >>
+                    (allele % bits_per_word)) &
+                   1;
+        }
+
+        return std::binary_search(indices_, indices_ + num_present_,
+                                  (index_t)allele);
+    }
+
+    // number of alleles present
+    int count() const
+    {
+        if (words_ == nullptr)
+        {
+            return num_present_;
+        }
+
+        int res = 0;
+        for (int w = 0; w < num_words(); w++)
+        {
+            res += __builtin_popcountll(words_[w]);
+        }
+        return res;
+    }
+
+    // calls f with each allele present, ascending, without visiting the
+    // absent ones
+    template <class F>
+    void for_each(F f) const
+    {
+        if (words_ == nullptr)
+        {
+            for (int k = 0; k < num_present_; k++)
+            {
+                f((int)indices_[k]);
+            }
+            return;
+        }
+
+        for (int w = 0; w < num_words(); w++)
+        {
+            for (word_t bits = words_[w]; bits != 0; bits &= bits - 1)
+            {
+                f(w * bits_per_word + __builtin_ctzll(bits));
+            }
+        }
+    }
+
+    // calls f(allele, present) with every allele, ascending, walking a
+    // sparse genotype's indices alongside rather than searching them
+    template <class F>
+    void for_all(F f) const
+    {
+        if (words_ == nullptr)
+        {
+            int next = 0;
+            for (int allele = 0; allele < num_alleles_; allele++)
+            {
+                const bool present =
+                    next < num_present_ && indices_[next] == allele;
+                next += present;
+                f(allele, present);
+            }
+            return;
+        }
+
+        for (int allele = 0; allele < num_alleles_; allele++)
+        {
+            f(allele, (*this)[allele] == 1);
+        }
+    }
+
+   private:
+    const word_t *words_ = nullptr;
+    const index_t *indices_ = nullptr;
+    int num_present_ = 0;
+    int num_alleles_ = 0;
+};
+
+#endif  // ALLELE_SET_H_
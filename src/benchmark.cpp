@@ -0,0 +1,149 @@
+#include "benchmark.h"
+
+#include "combination_indices_generator.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <chrono>
+
+KernelBenchmark::KernelBenchmark(const GenotypingData &genotyping_data,
+                                 const Lookup &lookup, Parameters params,
+                                 int coi, double min_seconds)
+    : genotyping_data(genotyping_data),
+      chain_(genotyping_data, lookup, params),
+      coi_(coi),
+      min_seconds_(min_seconds)
+{
+}
+
+template <class F>
+void KernelBenchmark::time(const std::string &kernel, F f)
+{
+    Timer<std::chrono::nanoseconds> timer;
+    const auto min_duration = std::chrono::duration<double>(min_seconds_);
+    int calls = 0;
+    timer.tick();
+    do
+    {
+        sink_ += f(calls);
+        ++calls;
+        timer.tock();
+    } while (timer.duration() < min_duration);
+
+    kernels_.push_back(kernel);
+    calls_.push_back(calls);
+    seconds_.push_back(
+        timer.duration<std::chrono::duration<double>>().count());
+}
+
+// each call takes the next sample and locus, so the cost is averaged over
+// the observed genotypes
+void KernelBenchmark::time_marginals()
+{
+    const size_t num_samples = genotyping_data.num_samples;
+    const size_t num_cells = genotyping_data.num_loci * num_samples;
+    Workspace &ws = chain_.seeded_workspace(0, RandomStream::Initialize, 0, 0);
+
+    const auto marginal = [&](int call, auto kernel) {
+        const size_t j = (call % num_cells) / num_samples;
+        const size_t i = call % num_samples;
+        return (double)kernel(genotyping_data.get_observed_alleles(j, i),
+                              chain_.p[j], chain_.eps_neg[i],
+                              chain_.eps_pos[i]);
+    };
+
+    time("prob_any_missing", [&](int call) {
+        const auto &freqs = chain_.p[(call % num_cells) / num_samples];
+        ws.prVec.assign(freqs.begin(),
+                        freqs.begin() + std::min<size_t>(coi_, freqs.size()));
+        return ws.probAnyMissing(ws.prVec, coi_);
+    });
+
+    time("exact_marginal", [&](int call) {
+        return marginal(call, [&](AlleleSet const &obs, auto const &freqs,
+                                  double eps_neg, double eps_pos) {
+            return chain_.calc_exact_genotype_marginal_llik(
+                obs, coi_, freqs, eps_neg, eps_pos, ws);
+        });
+    });
+
+    time("dp_marginal", [&](int call) {
+        return marginal(call, [&](AlleleSet const &obs, auto const &freqs,
+                                  double eps_neg, double eps_pos) {
+            return chain_.calc_dp_genotype_marginal_llik(
+                obs, coi_, freqs, eps_neg, eps_pos, ws);
+        });
+    });
+
+    const int sampling_depth =
+        chain_.params.importance_sampling_depth +
+        coi_ * chain_.params.importance_sampling_scaling_factor;
+    time("estimated_marginal", [&](int call) {
+        return marginal(call, [&](AlleleSet const &obs, auto const &freqs,
+                                  double eps_neg, double eps_pos) {
+            return chain_.calc_estimated_genotype_marginal_llik(
+                obs, obs, coi_, freqs, eps_neg, eps_pos, sampling_depth, ws);
+        });
+    });
+
+    // one call per combination, starting over once all are generated
+    const int num_alleles = genotyping_data.max_alleles;
+    CombinationIndicesGenerator gen(num_alleles, std::min(coi_, num_alleles));
+    time("combination_next", [&](int /*call*/) {
+        if (gen.completed)
+        {
+            gen.reset(num_alleles, std::min(coi_, num_alleles));
+        }
+        gen.next();
+        return (double)gen.curr[0];
+    });
+}
+
+// each call is one full sweep of the update, on the chain's own threads
+void KernelBenchmark::time_sweeps()
+{
+    const auto sweep = [&](void (Chain::*update)(int)) {
+        return [this, update](int call) {
+            (chain_.*update)(call);
+            return chain_.get_llik();
+        };
+    };
+
+    if (chain_.augmented())
+    {
+        time("update_latent_genotypes", sweep(&Chain::update_latent_genotypes));
+    }
+    time("update_m", sweep(&Chain::update_m));
+    time("update_p", sweep(&Chain::update_p));
+    time("update_eps", sweep(&Chain::update_eps));
+    time("update_eps_neg", sweep(&Chain::update_eps_neg));
+    time("update_eps_pos", sweep(&Chain::update_eps_pos));
+    time("update_individual_parameters",
+         sweep(&Chain::update_individual_parameters));
+    time("update_mean_coi", sweep(&Chain::update_mean_coi));
+}
+
+Rcpp::List KernelBenchmark::run()
+{
+    time_marginals();
+    time_sweeps();
+
+    std::vector<double> ns_per_call(calls_.size());
+    for (size_t k = 0; k < calls_.size(); k++)
+    {
+        ns_per_call[k] = seconds_[k] / calls_[k] * 1e9;
+    }
+
+    Rcpp::List res;
+    Rcpp::StringVector res_names;
+    res.push_back(Rcpp::wrap(kernels_));
+    res.push_back(Rcpp::wrap(calls_));
+    res.push_back(Rcpp::wrap(seconds_));
+    res.push_back(Rcpp::wrap(ns_per_call));
+    res_names.push_back("kernel");
+    res_names.push_back("calls");
+    res_names.push_back("seconds");
+    res_names.push_back("ns_per_call");
+    res.names() = res_names;
+    return res;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include "chain.h"
+#include "genotyping_data.h"
+#include "lookup.h"
+#include "parameters.h"
+
+#include <Rcpp.h>
+#include <string>
+#include <vector>
+
+/*
+ * Times the likelihood kernels and the chain's update sweeps on a dataset,
+ * each repeated until it has run for at least min_seconds. Kernels are
+ * evaluated at a fixed COI on every sample and locus in turn, under the
+ * chain's initial allele frequencies and error rates.
+ */
+class KernelBenchmark
+{
+   public:
+    KernelBenchmark(const GenotypingData &genotyping_data,
+                    const Lookup &lookup, Parameters params, int coi,
+                    double min_seconds);
+
+    // one row per kernel, the number of calls, the seconds they took and
+    // the nanoseconds per call
+    Rcpp::List run();
+
+   private:
+    const GenotypingData &genotyping_data;
+    Chain chain_;
+    int coi_;
+    double min_seconds_;
+
+    std::vector<std::string> kernels_{};
+    std::vector<double> calls_{};
+    std::vector<double> seconds_{};
+    // results are accumulated so the calls cannot be optimized away
+    volatile double sink_ = 0;
+
+    // f is called with the call number, returning a value to sink
+    template <class F>
+    void time(const std::string &kernel, F f);
+
+    void time_marginals();
+    void time_sweeps();
+};
+
+#endif  // BENCHMARK_H_
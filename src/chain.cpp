@@ -4,7 +4,55 @@
 #include "sampler.h"
 
 #include <algorithm>
-#include <map>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+// smallest warm start allele frequency
+constexpr double min_initial_freq = 1e-6;
+
+// acceptance rate the proposal scales are tuned towards, near optimal for one
+// dimensional random walks (Roberts and Rosenthal, 2001)
+constexpr double target_acceptance = 0.44;
+// Robbins-Monro steps shrink as iteration^-adaptation_decay, the scales
+// settling while burnin goes on
+constexpr double adaptation_decay = 0.6;
+// range of the tuned standard deviations and mean COI proposal sizes
+constexpr double min_proposal_sd = 1e-4;
+constexpr double max_proposal_sd = 10;
+constexpr double min_coi_prop_mean = 0.1;
+constexpr double max_coi_prop_mean = 10;
+
+// single allele moves of each latent genotype per data augmentation update
+constexpr int latent_moves_per_update = 3;
+
+// outcome of observing every allele of a locus given the latent genotype
+struct ObservationCounts
+{
+    int tp;
+    int fp;
+    int fn;
+    int tn;
+};
+
+// only the latent and observed alleles are counted, every other allele is a
+// true negative
+ObservationCounts count_observations(std::vector<int> const &allele_index_vec,
+                                     AlleleSet const &obs_genotype)
+{
+    int tp = 0;
+    for (const auto &allele : allele_index_vec)
+    {
+        tp += obs_genotype[allele];
+    }
+
+    const int total_latent = allele_index_vec.size();
+    const int fp = obs_genotype.count() - tp;
+    return {tp, fp, total_latent - tp,
+            obs_genotype.size() - total_latent - fp};
+}
+}  // namespace
 
 // Initialize P with empirical allele frequencies
 void Chain::initialize_p()
@@ -16,38 +64,60 @@ void Chain::initialize_p()
 
     for (size_t i = 0; i < genotyping_data.num_loci; i++)
     {
-        total_locus_alleles.push_back(
-            std::vector<int>(genotyping_data.num_alleles[i]));
-        total_alleles.push_back(0);
+        total_locus_alleles[i].assign(genotyping_data.num_alleles[i], 0);
         p.push_back(std::vector<double>(genotyping_data.num_alleles[i]));
+        // only the observed alleles are counted, the rest stay at 0
         for (size_t j = 0; j < genotyping_data.num_samples; j++)
         {
             const auto &sample_genotype =
                 genotyping_data.get_observed_alleles(i, j);
-            for (size_t k = 0; k < sample_genotype.size(); k++)
-            {
-                if (j == 0)
-                {
-                    total_locus_alleles[i].push_back(0);
-                }
-
-                total_locus_alleles[i][k] += sample_genotype[k];
-                total_alleles[i] += sample_genotype[k];
-            }
+            sample_genotype.for_each(
+                [&](int k) { total_locus_alleles[i][k]++; });
+            total_alleles[i] += sample_genotype.count();
         }
-        for (size_t j = 0; j < genotyping_data.num_alleles[i]; j++)
+        for (int j = 0; j < genotyping_data.num_alleles[i]; j++)
         {
             p[i][j] = (total_locus_alleles[i][j] + 1) /
                       ((double)total_alleles[i] +
                        genotyping_data.num_alleles[i]);  // Make sure at least 1
                                                          // allele everywhere
         }
+
+        // warm start from frequencies given for the same alleles
+        if (i < params.initial_allele_freqs.size() &&
+            params.initial_allele_freqs[i].size() == p[i].size())
+        {
+            const auto &initial = params.initial_allele_freqs[i];
+            if (std::none_of(initial.begin(), initial.end(),
+                             [](double x) { return std::isnan(x); }))
+            {
+                // keep every allele possible so the logit proposals are
+                // finite
+                double total = 0;
+                for (size_t j = 0; j < p[i].size(); j++)
+                {
+                    p[i][j] = std::max(initial[j], min_initial_freq);
+                    total += p[i][j];
+                }
+                for (auto &freq : p[i])
+                {
+                    freq /= total;
+                }
+            }
+        }
     }
 };
 
 void Chain::initialize_m()
 {
     m = genotyping_data.observed_coi;
+    for (size_t i = 0; i < params.initial_coi.size(); i++)
+    {
+        if (params.initial_coi[i] > 0)
+        {
+            m[i] = params.initial_coi[i];
+        }
+    }
     m_accept.resize(genotyping_data.num_samples, 0);
     individual_accept.resize(genotyping_data.num_samples, 0);
 }
@@ -55,24 +125,86 @@ void Chain::initialize_m()
 void Chain::initialize_eps_neg()
 {
     eps_neg.resize(genotyping_data.num_samples, params.eps_neg_0);
+    for (size_t i = 0; i < params.initial_eps_neg.size(); i++)
+    {
+        const double initial = params.initial_eps_neg[i];
+        if (initial > 0 && initial < params.max_eps_neg)
+        {
+            eps_neg[i] = initial;
+        }
+    }
     eps_neg_accept.resize(genotyping_data.num_samples, 0);
 }
 
 void Chain::initialize_eps_pos()
 {
     eps_pos.resize(genotyping_data.num_samples, params.eps_pos_0);
+    for (size_t i = 0; i < params.initial_eps_pos.size(); i++)
+    {
+        const double initial = params.initial_eps_pos[i];
+        if (initial > 0 && initial < params.max_eps_pos)
+        {
+            eps_pos[i] = initial;
+        }
+    }
     eps_pos_accept.resize(genotyping_data.num_samples, 0);
 }
 
 void Chain::initialize_mean_coi()
 {
     mean_coi = params.mean_coi_prior_shape * params.mean_coi_prior_scale;
+    if (params.initial_mean_coi > 0)
+    {
+        mean_coi = params.initial_mean_coi;
+    }
+}
+
+// latent genotypes start as the observed ones, cut down to the COI, or the
+// most common allele where nothing was observed
+void Chain::initialize_latent_genotypes()
+{
+    if (!augmented())
+    {
+        return;
+    }
+
+    latent_genotypes_.assign(
+        genotyping_data.num_loci * genotyping_data.num_samples, {});
+    for (size_t j = 0; j < genotyping_data.num_loci; j++)
+    {
+        for (size_t i = 0; i < genotyping_data.num_samples; i++)
+        {
+            if (genotyping_data.is_missing(j, i))
+            {
+                continue;
+            }
+
+            std::vector<int> &latent =
+                latent_genotypes_[j * genotyping_data.num_samples + i];
+            genotyping_data.get_observed_alleles(j, i).for_each(
+                [&](int allele) {
+                    if ((int)latent.size() < m[i])
+                    {
+                        latent.push_back(allele);
+                    }
+                });
+            if (latent.empty())
+            {
+                latent.push_back(std::max_element(p[j].begin(), p[j].end()) -
+                                 p[j].begin());
+            }
+        }
+    }
 }
 
 void Chain::update_mean_coi(int iteration)
 {
-    double prop_mean_coi =
-        sampler.sample_epsilon(mean_coi, params.mean_coi_var);
+    const ProfiledScope profiled(profiling(), ProfiledUpdate::MeanCoi);
+    sampler.seed(params.seed,
+                 Sampler::stream_id(RandomStream::MeanCoi, chain_id_),
+                 iteration);
+    double prop_mean_coi = sampler.sample_epsilon(mean_coi, mean_coi_var);
+    double log_accept = -std::numeric_limits<double>::infinity();
 
     if (prop_mean_coi > 0)
     {
@@ -84,25 +216,42 @@ void Chain::update_mean_coi(int iteration)
             sum_orig += sampler.get_coi_log_prob(m[ii], mean_coi);
         }
 
-        sum_can += sampler.get_coi_mean_log_prior(prop_mean_coi,
-                                                  params.mean_coi_prior_shape,
-                                                  params.mean_coi_prior_scale);
+        sum_can += sampler.get_coi_mean_log_prior(
+            prop_mean_coi, params.mean_coi_prior_shape,
+            params.mean_coi_prior_scale, params.mean_coi_prior_log_gamma);
 
         sum_orig += sampler.get_coi_mean_log_prior(
-            mean_coi, params.mean_coi_prior_shape, params.mean_coi_prior_scale);
+            mean_coi, params.mean_coi_prior_shape, params.mean_coi_prior_scale,
+            params.mean_coi_prior_log_gamma);
 
-        if (sampler.sample_log_mh_acceptance() <= (sum_can - sum_orig))
+        log_accept = sum_can - sum_orig;
+        if (sampler.sample_log_mh_acceptance() <= log_accept)
         {
+            llik += log_accept;
             mean_coi = prop_mean_coi;
         }
     }
+    mean_coi_var = adapt_scale(mean_coi_var, log_accept, iteration,
+                               min_proposal_sd, max_proposal_sd);
 }
 
 void Chain::update_m(int iteration)
 {
-    for (size_t i = 0; i < genotyping_data.num_samples; i++)
+    const ProfiledScope profiled(profiling(), ProfiledUpdate::Coi);
+    if (params.coi_tries > 1)
     {
-        int prop_m = m[i] + sampler.sample_coi_delta(3);
+        update_m_multiple_try(iteration);
+        return;
+    }
+
+    reset_llik_deltas(genotyping_data.num_samples);
+    pool_->parallel_for(genotyping_data.num_samples, [&](size_t i, int t) {
+        Workspace &ws =
+            seeded_workspace(t, RandomStream::Coi, i, iteration);
+        double *proposed = llik_store_.spare(t);
+        std::fill(proposed, proposed + genotyping_data.num_loci, 0);
+        int prop_m = m[i] + ws.sampler.sample_coi_delta(m_prop_mean[i]);
+        double log_accept = -std::numeric_limits<double>::infinity();
 
         if (prop_m > 0)
         {
@@ -113,29 +262,213 @@ void Chain::update_m(int iteration)
             {
                 if (!genotyping_data.is_missing(j, i))
                 {
-                    llik_new[j][i] = calc_genotype_marginal_llik(
-                        genotyping_data.get_observed_alleles(j, i), prop_m,
-                        p[j], eps_neg[i], eps_pos[i]);
-                    sum_can += llik_new[j][i];
-                    sum_orig += llik_old[j][i];
+                    proposed[j] = cached_genotype_marginal_llik(j, i, prop_m, ws);
+                    sum_can += proposed[j];
+                    sum_orig += llik_store_(j, i);
                 }
             }
 
+            const double data_delta = sum_can - sum_orig;
+
+            // tempered chains see the data likelihood raised to 1 / temp
+            sum_can /= temp;
+            sum_orig /= temp;
+
             // ZTPoisson prior on COI
-            sum_can += sampler.get_coi_log_prob(prop_m, mean_coi);
-            sum_orig += sampler.get_coi_log_prob(m[i], mean_coi);
+            sum_can += ws.sampler.get_coi_log_prob(prop_m, mean_coi);
+            sum_orig += ws.sampler.get_coi_log_prob(m[i], mean_coi);
 
             // Accept
-            if (sampler.sample_log_mh_acceptance() <= (sum_can - sum_orig))
+            log_accept = sum_can - sum_orig;
+            if (ws.sampler.sample_log_mh_acceptance() <= log_accept)
             {
+                llik_deltas_[i] = untempered_delta(log_accept, data_delta);
                 m[i] = prop_m;
-                for (size_t j = 0; j < genotyping_data.num_loci; j++)
+                llik_store_.accept_sample(i, t);
+                m_accept[i] += 1;
+            }
+        }
+        m_prop_mean[i] = adapt_scale(m_prop_mean[i], log_accept, iteration,
+                                     min_coi_prop_mean, max_coi_prop_mean);
+    });
+    apply_llik_deltas();
+}
+
+/*
+ * Multiple-try Metropolis (Liu, Liang and Wong, 2000) over each sample's
+ * COI. coi_tries COIs are proposed around the current one and one of them
+ * selected in proportion to its posterior; coi_tries - 1 reference COIs are
+ * then proposed around the selected one, the current COI making up the
+ * last, and the move is accepted with the ratio of the posterior mass of
+ * the tries to that of the references. All the COIs of a set are scored
+ * together, so a wide set of tries costs little more than a single
+ * proposal, and large jumps are accepted far more often.
+ */
+void Chain::update_m_multiple_try(int iteration)
+{
+    const int tries = params.coi_tries;
+    reset_llik_deltas(genotyping_data.num_samples);
+    pool_->parallel_for(genotyping_data.num_samples, [&](size_t i, int t) {
+        Workspace &ws =
+            seeded_workspace(t, RandomStream::Coi, i, iteration);
+        double *proposed = llik_store_.spare(t);
+        std::fill(proposed, proposed + genotyping_data.num_loci, 0);
+
+        // tries in [0, tries), references in [tries, 2 * tries)
+        ws.coiTries.resize(2 * tries);
+        for (int k = 0; k < tries; k++)
+        {
+            ws.coiTries[k] = m[i] + ws.sampler.sample_coi_delta(m_prop_mean[i]);
+        }
+        score_coi_tries(i, 0, tries, ws);
+        const double log_tries =
+            UtilFunctions::logSumExp(ws.tryScores.begin(), ws.tryScores.end());
+
+        double log_accept = -std::numeric_limits<double>::infinity();
+        if (log_tries > -std::numeric_limits<double>::infinity())
+        {
+            // select a try in proportion to its posterior
+            const double u = ws.sampler.runif_0_1();
+            int selected = 0;
+            double cumulative = std::exp(ws.tryScores[0] - log_tries);
+            while (cumulative < u && selected + 1 < tries)
+            {
+                cumulative += std::exp(ws.tryScores[++selected] - log_tries);
+            }
+            const int prop_m = ws.coiTries[selected];
+            const double prop_score = ws.tryScores[selected];
+
+            // keep the selected COI's marginals before the references are
+            // scored over them
+            const size_t candidate = ws.tryCandidates[selected];
+            double sum_can = 0;
+            double sum_orig = 0;
+            for (size_t j = 0; j < genotyping_data.num_loci; j++)
+            {
+                if (!genotyping_data.is_missing(j, i))
                 {
-                    llik_old[j][i] = llik_new[j][i];
+                    proposed[j] = ws.candidateMarginals
+                        [candidate * genotyping_data.num_loci + j];
+                    sum_can += proposed[j];
+                    sum_orig += llik_store_(j, i);
                 }
+            }
+            const double curr_score =
+                sum_orig / temp + ws.sampler.get_coi_log_prob(m[i], mean_coi);
+
+            for (int k = 0; k < tries - 1; k++)
+            {
+                ws.coiTries[tries + k] =
+                    prop_m + ws.sampler.sample_coi_delta(m_prop_mean[i]);
+            }
+            ws.coiTries[2 * tries - 1] = m[i];
+            score_coi_tries(i, tries, 2 * tries, ws);
+            const double log_references = UtilFunctions::logSumExp(
+                ws.tryScores.begin(), ws.tryScores.end());
+
+            log_accept = log_tries - log_references;
+            if (ws.sampler.sample_log_mh_acceptance() <= log_accept)
+            {
+                llik_deltas_[i] = untempered_delta(prop_score - curr_score,
+                                                   sum_can - sum_orig);
+                m[i] = prop_m;
+                llik_store_.accept_sample(i, t);
                 m_accept[i] += 1;
+                for (size_t j = 0; j < genotyping_data.num_loci; j++)
+                {
+                    if (!genotyping_data.is_missing(j, i))
+                    {
+                        cache_marginal_llik(j, i, prop_m, llik_store_(j, i));
+                    }
+                }
+            }
+        }
+        m_prop_mean[i] = adapt_scale(m_prop_mean[i], log_accept, iteration,
+                                     min_coi_prop_mean, max_coi_prop_mean);
+    });
+    apply_llik_deltas();
+}
+
+/*
+ * Tempered log posterior, up to a constant, of sample i at each of the COIs
+ * ws.coiTries[first, last), -inf for those below 1, into ws.tryScores. The
+ * distinct valid COIs are left in ws.coiCandidates, ascending with the
+ * current COI last, their marginals in ws.candidateMarginals, one block of
+ * loci per candidate, and the candidate of each try in ws.tryCandidates. The
+ * current COI's marginals are the stored ones.
+ */
+void Chain::score_coi_tries(size_t i, size_t first, size_t last,
+                            Workspace &ws)
+{
+    const size_t num_loci = genotyping_data.num_loci;
+
+    ws.coiCandidates.clear();
+    for (size_t k = first; k < last; k++)
+    {
+        if (ws.coiTries[k] > 0 && ws.coiTries[k] != m[i])
+        {
+            ws.coiCandidates.push_back(ws.coiTries[k]);
+        }
+    }
+    std::sort(ws.coiCandidates.begin(), ws.coiCandidates.end());
+    ws.coiCandidates.erase(
+        std::unique(ws.coiCandidates.begin(), ws.coiCandidates.end()),
+        ws.coiCandidates.end());
+
+    // the current COI goes in last so it is never computed
+    const size_t num_computed = ws.coiCandidates.size();
+    ws.candidateMarginals.assign((num_computed + 1) * num_loci, 0);
+    for (size_t j = 0; j < num_loci; j++)
+    {
+        if (genotyping_data.is_missing(j, i))
+        {
+            continue;
+        }
+        if (num_computed > 0)
+        {
+            cached_genotype_marginal_lliks(j, i, ws.coiCandidates, ws,
+                                           ws.locusLliks);
+            for (size_t c = 0; c < num_computed; c++)
+            {
+                ws.candidateMarginals[c * num_loci + j] = ws.locusLliks[c];
             }
         }
+        ws.candidateMarginals[num_computed * num_loci + j] = llik_store_(j, i);
+    }
+    ws.coiCandidates.push_back(m[i]);
+
+    ws.candidateScores.resize(num_computed + 1);
+    for (size_t c = 0; c <= num_computed; c++)
+    {
+        double data_llik = 0;
+        for (size_t j = 0; j < num_loci; j++)
+        {
+            data_llik += ws.candidateMarginals[c * num_loci + j];
+        }
+        ws.candidateScores[c] =
+            data_llik / temp +
+            ws.sampler.get_coi_log_prob(ws.coiCandidates[c], mean_coi);
+    }
+
+    ws.tryScores.resize(last - first);
+    ws.tryCandidates.resize(last - first);
+    for (size_t k = first; k < last; k++)
+    {
+        double score = -std::numeric_limits<double>::infinity();
+        size_t c = num_computed;
+        if (ws.coiTries[k] > 0 && ws.coiTries[k] != m[i])
+        {
+            c = std::lower_bound(ws.coiCandidates.begin(),
+                                 ws.coiCandidates.begin() + num_computed,
+                                 ws.coiTries[k]) -
+                ws.coiCandidates.begin();
+        }
+        if (ws.coiTries[k] > 0)
+        {
+            score = ws.candidateScores[c];
+        }
+        ws.tryScores[k - first] = score;
+        ws.tryCandidates[k - first] = c;
     }
 }
 
@@ -145,19 +478,28 @@ void Chain::update_m(int iteration)
  */
 void Chain::update_p(int iteration)
 {
-    for (size_t j = 0; j < genotyping_data.num_loci; j++)
-    {
+    const ProfiledScope profiled(profiling(),
+                                 ProfiledUpdate::AlleleFrequencies);
+
+    // Loci are independent given the sample parameters. Each locus draws from
+    // its own stream, keyed on the locus and iteration, so the result does
+    // not depend on how loci are split across threads.
+    reset_llik_deltas(genotyping_data.num_loci);
+    pool_->parallel_for(genotyping_data.num_loci, [&](size_t j, int t) {
+        Workspace &ws =
+            seeded_workspace(t, RandomStream::AlleleFrequency, j, iteration);
+
         int rep = 1;
         while (--rep >= 0)
         {
             int k = p[j].size();
-            const int idx = sampler.sample_random_int(0, k - 1);
+            const int idx = ws.sampler.sample_random_int(0, k - 1);
 
             auto logitPropP = UtilFunctions::logitVec(p[j]);
 
             double logitCurr = logitPropP[idx];
             double logitProp =
-                sampler.sample_epsilon(logitCurr, params.allele_freq_var);
+                ws.sampler.sample_epsilon(logitCurr, p_prop_var[j]);
 
             auto currLogPQ = UtilFunctions::log_pq(logitCurr);
             auto propLogPQ = UtilFunctions::log_pq(logitProp);
@@ -177,61 +519,99 @@ void Chain::update_p(int iteration)
             {
                 if (el < 1e-12)
                 {
+                    // reject, moving on to the next locus
+                    p_prop_var[j] = adapt_scale(
+                        p_prop_var[j], -std::numeric_limits<double>::infinity(),
+                        iteration, min_proposal_sd, max_proposal_sd);
                     return;
                 }
             }
 
+            // samples sharing an observed genotype, coi and error rates have
+            // the same marginal, only evaluate it once. Latent genotypes
+            // differ between samples, so not with data augmentation
+            const bool memoize = !augmented();
+            ws.pattern_memo.clear();
+            std::vector<double> &proposed = ws.locusLlik;
+            proposed.assign(genotyping_data.num_samples, 0);
+
             double sum_can = 0;
             double sum_orig = 0;
             for (size_t i = 0; i < genotyping_data.num_samples; i++)
             {
                 if (!genotyping_data.is_missing(j, i))
                 {
-                    const auto observed_alleles =
-                        genotyping_data.get_observed_alleles(j, i);
-                    auto emphasized_alleles = observed_alleles;
-                    emphasized_alleles[idx] = 1;
-
-                    // llik_new[j][i] = calc_genotype_marginal_llik(
-                    // observed_alleles, emphasized_alleles, m[i], prop_p,
-                    // eps_neg[i], eps_pos[i]);
-                    llik_new[j][i] = calc_genotype_marginal_llik(
-                        observed_alleles, m[i], prop_p, eps_neg[i], eps_pos[i]);
-
-                    // UtilFunctions::print("O/N:", llik_old[j][i],
-                    //                      llik_new[j][i]);
-                    sum_can += llik_new[j][i];
-                    sum_orig += llik_old[j][i];
+                    const PatternKey key{
+                        genotyping_data.get_genotype_pattern(j, i), m[i],
+                        eps_neg[i], eps_pos[i]};
+                    auto memo = ws.pattern_memo.end();
+                    if (memoize)
+                    {
+                        memo = ws.pattern_memo.find(key);
+                        if (params.profile)
+                        {
+                            ws.profile.pattern_memo.record(
+                                memo != ws.pattern_memo.end());
+                        }
+                    }
+
+                    if (memo != ws.pattern_memo.end())
+                    {
+                        proposed[i] = memo->second;
+                    }
+                    else
+                    {
+                        proposed[i] = genotype_llik(j, i, m[i], prop_p,
+                                                    eps_neg[i], eps_pos[i], ws);
+                        if (memoize)
+                        {
+                            ws.pattern_memo.emplace(key, proposed[i]);
+                        }
+                    }
+
+                    sum_can += proposed[i];
+                    sum_orig += llik_store_(j, i);
                 }
             }
 
-            double acceptanceRatio = sum_can - sum_orig + logAdj;
-            // UtilFunctions::print_vector(prop_p);
-            // UtilFunctions::print_vector(p[j]);
-            // UtilFunctions::print("Accept:", sum_can, sum_orig, logAdj,
-                                 // acceptanceRatio);
-            if (sampler.sample_log_mh_acceptance() <= acceptanceRatio)
+            double acceptanceRatio = (sum_can - sum_orig) / temp + logAdj;
+            if (ws.sampler.sample_log_mh_acceptance() <= acceptanceRatio)
             {
+                llik_deltas_[j] = sum_can - sum_orig;
                 p[j] = prop_p;
                 p_accept[j] += 1;
+                marginal_cache_.invalidate_locus(j);
                 for (size_t i = 0; i < genotyping_data.num_samples; i++)
                 {
-                    llik_old[j][i] = llik_new[j][i];
+                    if (!genotyping_data.is_missing(j, i))
+                    {
+                        llik_store_(j, i) = proposed[i];
+                        cache_marginal_llik(j, i, m[i], proposed[i]);
+                    }
                 }
             }
+            p_prop_var[j] = adapt_scale(p_prop_var[j], acceptanceRatio,
+                                        iteration, min_proposal_sd,
+                                        max_proposal_sd);
         }
-    }
+    });
+    apply_llik_deltas();
 }
 
 // unused at the moment, updating eps_pos/eps_neg independently
 void Chain::update_eps(int iteration)
 {
-    for (size_t i = 0; i < m.size(); i++)
-    {
+    const ProfiledScope profiled(profiling(), ProfiledUpdate::Eps);
+    reset_llik_deltas(genotyping_data.num_samples);
+    pool_->parallel_for(genotyping_data.num_samples, [&](size_t i, int t) {
+        Workspace &ws =
+            seeded_workspace(t, RandomStream::Eps, i, iteration);
+        double *proposed = llik_store_.spare(t);
+        std::fill(proposed, proposed + genotyping_data.num_loci, 0);
         double prop_eps_pos =
-            sampler.sample_epsilon_pos(eps_pos[i], eps_pos_var);
+            ws.sampler.sample_epsilon_pos(eps_pos[i], eps_pos_var[i]);
         double prop_eps_neg =
-            sampler.sample_epsilon_neg(eps_neg[i], eps_neg_var);
+            ws.sampler.sample_epsilon_neg(eps_neg[i], eps_neg_var[i]);
 
         if (prop_eps_pos < params.max_eps_pos && prop_eps_pos > 0 &&
             prop_eps_neg < params.max_eps_neg && prop_eps_neg > 0)
@@ -243,48 +623,69 @@ void Chain::update_eps(int iteration)
             {
                 if (!genotyping_data.is_missing(j, i))
                 {
-                    llik_new[j][i] = calc_genotype_marginal_llik(
-                        genotyping_data.get_observed_alleles(j, i), m[i], p[j],
-                        prop_eps_neg, prop_eps_pos);
-                    sum_can += llik_new[j][i];
-                    sum_orig += llik_old[j][i];
+                    proposed[j] = genotype_llik(j, i, m[i], p[j], prop_eps_neg,
+                                                prop_eps_pos, ws);
+                    sum_can += proposed[j];
+                    sum_orig += llik_store_(j, i);
                 }
             }
 
+            const double data_delta = sum_can - sum_orig;
+
+            // tempered chains see the data likelihood raised to 1 / temp
+            sum_can /= temp;
+            sum_orig /= temp;
+
             // Incorporate prior
-            sum_can += sampler.get_epsilon_log_prior(
-                prop_eps_neg, params.eps_neg_alpha, params.eps_neg_beta);
-            sum_can += sampler.get_epsilon_log_prior(
-                prop_eps_pos, params.eps_pos_alpha, params.eps_pos_beta);
-            sum_orig += sampler.get_epsilon_log_prior(
-                eps_neg[i], params.eps_neg_alpha, params.eps_neg_beta);
-            sum_orig += sampler.get_epsilon_log_prior(
-                eps_pos[i], params.eps_pos_alpha, params.eps_pos_beta);
+            sum_can += ws.sampler.get_epsilon_log_prior(
+                prop_eps_neg, params.eps_neg_alpha, params.eps_neg_beta,
+                params.eps_neg_log_beta);
+            sum_can += ws.sampler.get_epsilon_log_prior(
+                prop_eps_pos, params.eps_pos_alpha, params.eps_pos_beta,
+                params.eps_pos_log_beta);
+            sum_orig += ws.sampler.get_epsilon_log_prior(
+                eps_neg[i], params.eps_neg_alpha, params.eps_neg_beta,
+                params.eps_neg_log_beta);
+            sum_orig += ws.sampler.get_epsilon_log_prior(
+                eps_pos[i], params.eps_pos_alpha, params.eps_pos_beta,
+                params.eps_pos_log_beta);
 
             // Accept
-            if (sampler.sample_log_mh_acceptance() <= (sum_can - sum_orig))
+            if (ws.sampler.sample_log_mh_acceptance() <= (sum_can - sum_orig))
             {
+                llik_deltas_[i] =
+                    untempered_delta(sum_can - sum_orig, data_delta);
                 eps_pos[i] = prop_eps_pos;
                 eps_pos_accept[i] += 1;
 
                 eps_neg[i] = prop_eps_neg;
                 eps_neg_accept[i] += 1;
 
-                for (size_t j = 0; j < genotyping_data.num_loci; j++)
-                {
-                    llik_old[j][i] = llik_new[j][i];
-                }
+                accept_sample_marginals(i, t);
             }
         }
-    }
+    });
+    apply_llik_deltas();
 }
 
 void Chain::update_eps_pos(int iteration)
 {
-    for (size_t i = 0; i < m.size(); i++)
+    const ProfiledScope profiled(profiling(), ProfiledUpdate::EpsPos);
+    if (augmented())
     {
+        update_eps_conjugate(iteration, false);
+        return;
+    }
+
+    reset_llik_deltas(genotyping_data.num_samples);
+    pool_->parallel_for(genotyping_data.num_samples, [&](size_t i, int t) {
+        Workspace &ws =
+            seeded_workspace(t, RandomStream::EpsPos, i, iteration);
+        double *proposed = llik_store_.spare(t);
+        std::fill(proposed, proposed + genotyping_data.num_loci, 0);
         double prop_eps_pos =
-            sampler.sample_epsilon_pos(eps_pos[i], eps_pos_var);
+            ws.sampler.sample_epsilon_pos(eps_pos[i], eps_pos_var[i]);
+        double log_accept = -std::numeric_limits<double>::infinity();
 
         if (prop_eps_pos < params.max_eps_pos && prop_eps_pos > 0)
         {
@@ -295,40 +696,62 @@ void Chain::update_eps_pos(int iteration)
             {
                 if (!genotyping_data.is_missing(j, i))
                 {
-                    llik_new[j][i] = calc_genotype_marginal_llik(
-                        genotyping_data.get_observed_alleles(j, i), m[i], p[j],
-                        eps_neg[i], prop_eps_pos);
-                    sum_can += llik_new[j][i];
-                    sum_orig += llik_old[j][i];
+                    proposed[j] = genotype_llik(j, i, m[i], p[j], eps_neg[i],
+                                                prop_eps_pos, ws);
+                    sum_can += proposed[j];
+                    sum_orig += llik_store_(j, i);
                 }
             }
 
+            const double data_delta = sum_can - sum_orig;
+
+            // tempered chains see the data likelihood raised to 1 / temp
+            sum_can /= temp;
+            sum_orig /= temp;
+
             // Incorporate prior
-            sum_can += sampler.get_epsilon_log_prior(
-                prop_eps_pos, params.eps_pos_alpha, params.eps_pos_beta);
-            sum_orig += sampler.get_epsilon_log_prior(
-                eps_pos[i], params.eps_pos_alpha, params.eps_pos_beta);
+            sum_can += ws.sampler.get_epsilon_log_prior(
+                prop_eps_pos, params.eps_pos_alpha, params.eps_pos_beta,
+                params.eps_pos_log_beta);
+            sum_orig += ws.sampler.get_epsilon_log_prior(
+                eps_pos[i], params.eps_pos_alpha, params.eps_pos_beta,
+                params.eps_pos_log_beta);
 
             // Accept
-            if (sampler.sample_log_mh_acceptance() <= (sum_can - sum_orig))
+            log_accept = sum_can - sum_orig;
+            if (ws.sampler.sample_log_mh_acceptance() <= log_accept)
             {
+                llik_deltas_[i] = untempered_delta(log_accept, data_delta);
                 eps_pos[i] = prop_eps_pos;
                 eps_pos_accept[i] += 1;
-                for (size_t j = 0; j < genotyping_data.num_loci; j++)
-                {
-                    llik_old[j][i] = llik_new[j][i];
-                }
+                accept_sample_marginals(i, t);
             }
         }
-    }
+        eps_pos_var[i] =
+            adapt_scale(eps_pos_var[i], log_accept, iteration,
+                        min_proposal_sd, params.max_eps_pos);
+    });
+    apply_llik_deltas();
 }
 
 void Chain::update_eps_neg(int iteration)
 {
-    for (size_t i = 0; i < m.size(); i++)
+    const ProfiledScope profiled(profiling(), ProfiledUpdate::EpsNeg);
+    if (augmented())
     {
+        update_eps_conjugate(iteration, true);
+        return;
+    }
+
+    reset_llik_deltas(genotyping_data.num_samples);
+    pool_->parallel_for(genotyping_data.num_samples, [&](size_t i, int t) {
+        Workspace &ws =
+            seeded_workspace(t, RandomStream::EpsNeg, i, iteration);
+        double *proposed = llik_store_.spare(t);
+        std::fill(proposed, proposed + genotyping_data.num_loci, 0);
         double prop_eps_neg =
-            sampler.sample_epsilon_neg(eps_neg[i], eps_neg_var);
+            ws.sampler.sample_epsilon_neg(eps_neg[i], eps_neg_var[i]);
+        double log_accept = -std::numeric_limits<double>::infinity();
 
         if (prop_eps_neg < params.max_eps_neg && prop_eps_neg > 0)
         {
@@ -339,43 +762,58 @@ void Chain::update_eps_neg(int iteration)
             {
                 if (!genotyping_data.is_missing(j, i))
                 {
-                    llik_new[j][i] = calc_genotype_marginal_llik(
-                        genotyping_data.get_observed_alleles(j, i), m[i], p[j],
-                        prop_eps_neg, eps_pos[i]);
-                    sum_can += llik_new[j][i];
-                    sum_orig += llik_old[j][i];
+                    proposed[j] = genotype_llik(j, i, m[i], p[j], prop_eps_neg,
+                                                eps_pos[i], ws);
+                    sum_can += proposed[j];
+                    sum_orig += llik_store_(j, i);
                 }
             }
 
+            const double data_delta = sum_can - sum_orig;
+
+            // tempered chains see the data likelihood raised to 1 / temp
+            sum_can /= temp;
+            sum_orig /= temp;
+
             // // Incorporate prior
-            sum_can += sampler.get_epsilon_log_prior(
-                prop_eps_neg, params.eps_neg_alpha, params.eps_neg_beta);
-            sum_orig += sampler.get_epsilon_log_prior(
-                eps_neg[i], params.eps_neg_alpha, params.eps_neg_beta);
+            sum_can += ws.sampler.get_epsilon_log_prior(
+                prop_eps_neg, params.eps_neg_alpha, params.eps_neg_beta,
+                params.eps_neg_log_beta);
+            sum_orig += ws.sampler.get_epsilon_log_prior(
+                eps_neg[i], params.eps_neg_alpha, params.eps_neg_beta,
+                params.eps_neg_log_beta);
 
             // Accept
-            if (sampler.sample_log_mh_acceptance() <= (sum_can - sum_orig))
+            log_accept = sum_can - sum_orig;
+            if (ws.sampler.sample_log_mh_acceptance() <= log_accept)
             {
+                llik_deltas_[i] = untempered_delta(log_accept, data_delta);
                 eps_neg[i] = prop_eps_neg;
                 eps_neg_accept[i] += 1;
-                for (size_t j = 0; j < genotyping_data.num_loci; j++)
-                {
-                    llik_old[j][i] = llik_new[j][i];
-                }
+                accept_sample_marginals(i, t);
             }
         }
-    }
+        eps_neg_var[i] =
+            adapt_scale(eps_neg_var[i], log_accept, iteration,
+                        min_proposal_sd, params.max_eps_neg);
+    });
+    apply_llik_deltas();
 }
 
 void Chain::update_individual_parameters(int iteration)
 {
-    for (size_t i = 0; i < m.size(); i++)
-    {
-        int prop_m = m[i] + sampler.sample_coi_delta(2);
+    const ProfiledScope profiled(profiling(), ProfiledUpdate::Individual);
+    reset_llik_deltas(genotyping_data.num_samples);
+    pool_->parallel_for(genotyping_data.num_samples, [&](size_t i, int t) {
+        Workspace &ws =
+            seeded_workspace(t, RandomStream::Individual, i, iteration);
+        double *proposed = llik_store_.spare(t);
+        std::fill(proposed, proposed + genotyping_data.num_loci, 0);
+        int prop_m = m[i] + ws.sampler.sample_coi_delta(2);
         double prop_eps_neg =
-            sampler.sample_epsilon_neg(eps_neg[i], eps_neg_var);
+            ws.sampler.sample_epsilon_neg(eps_neg[i], eps_neg_var[i]);
         double prop_eps_pos =
-            sampler.sample_epsilon_neg(eps_pos[i], eps_pos_var);
+            ws.sampler.sample_epsilon_neg(eps_pos[i], eps_pos_var[i]);
 
         if (prop_eps_neg < params.max_eps_neg && prop_eps_neg > 0 &&
             prop_eps_pos < params.max_eps_pos && prop_eps_pos > 0 && prop_m &&
@@ -388,66 +826,313 @@ void Chain::update_individual_parameters(int iteration)
             {
                 if (!genotyping_data.is_missing(j, i))
                 {
-                    llik_new[j][i] = calc_genotype_marginal_llik(
-                        genotyping_data.get_observed_alleles(j, i), prop_m,
-                        p[j], prop_eps_neg, prop_eps_pos);
-                    sum_can += llik_new[j][i];
-                    sum_orig += llik_old[j][i];
+                    proposed[j] = genotype_llik(j, i, prop_m, p[j],
+                                                prop_eps_neg, prop_eps_pos, ws);
+                    sum_can += proposed[j];
+                    sum_orig += llik_store_(j, i);
                 }
             }
 
+            const double data_delta = sum_can - sum_orig;
+
+            // tempered chains see the data likelihood raised to 1 / temp
+            sum_can /= temp;
+            sum_orig /= temp;
+
             // Incorporate priors
-            sum_can += sampler.get_epsilon_log_prior(
-                prop_eps_neg, params.eps_neg_alpha, params.eps_neg_beta);
-            sum_orig += sampler.get_epsilon_log_prior(
-                eps_neg[i], params.eps_neg_alpha, params.eps_neg_beta);
-            sum_can += sampler.get_epsilon_log_prior(
-                prop_eps_pos, params.eps_pos_alpha, params.eps_pos_beta);
-            sum_orig += sampler.get_epsilon_log_prior(
-                eps_pos[i], params.eps_pos_alpha, params.eps_pos_beta);
-            sum_can += sampler.get_coi_log_prob(prop_m, mean_coi);
-            sum_orig += sampler.get_coi_log_prob(m[i], mean_coi);
+            sum_can += ws.sampler.get_epsilon_log_prior(
+                prop_eps_neg, params.eps_neg_alpha, params.eps_neg_beta,
+                params.eps_neg_log_beta);
+            sum_orig += ws.sampler.get_epsilon_log_prior(
+                eps_neg[i], params.eps_neg_alpha, params.eps_neg_beta,
+                params.eps_neg_log_beta);
+            sum_can += ws.sampler.get_epsilon_log_prior(
+                prop_eps_pos, params.eps_pos_alpha, params.eps_pos_beta,
+                params.eps_pos_log_beta);
+            sum_orig += ws.sampler.get_epsilon_log_prior(
+                eps_pos[i], params.eps_pos_alpha, params.eps_pos_beta,
+                params.eps_pos_log_beta);
+            sum_can += ws.sampler.get_coi_log_prob(prop_m, mean_coi);
+            sum_orig += ws.sampler.get_coi_log_prob(m[i], mean_coi);
 
             // Accept
-            if (sampler.sample_log_mh_acceptance() <= (sum_can - sum_orig))
+            if (ws.sampler.sample_log_mh_acceptance() <= (sum_can - sum_orig))
             {
+                llik_deltas_[i] =
+                    untempered_delta(sum_can - sum_orig, data_delta);
                 m[i] = prop_m;
                 eps_neg[i] = prop_eps_neg;
                 eps_pos[i] = prop_eps_pos;
                 individual_accept[i] += 1;
-                for (size_t j = 0; j < genotyping_data.num_loci; j++)
+                accept_sample_marginals(i, t);
+            }
+        }
+    });
+    apply_llik_deltas();
+}
+
+/*
+ * Data augmentation moves. Each latent genotype takes a few Metropolis-Hastings
+ * steps, each adding an allele, removing one or swapping one for another,
+ * chosen uniformly among those possible. Added alleles are observed alleles
+ * missing from the set half the time, when there are any, and uniform over
+ * the missing alleles otherwise. Only the sample's likelihood at the one
+ * locus is needed, the inclusion-exclusion over the latent alleles being
+ * the largest cost, so a sweep is linear in the data.
+ */
+void Chain::update_latent_genotypes(int iteration)
+{
+    const ProfiledScope profiled(profiling(),
+                                 ProfiledUpdate::LatentGenotypes);
+    reset_llik_deltas(genotyping_data.num_samples);
+    pool_->parallel_for(genotyping_data.num_samples, [&](size_t i, int t) {
+        Workspace &ws =
+            seeded_workspace(t, RandomStream::Latent, i, iteration);
+        for (size_t j = 0; j < genotyping_data.num_loci; j++)
+        {
+            if (genotyping_data.is_missing(j, i))
+            {
+                continue;
+            }
+
+            const AlleleSet obs_genotype =
+                genotyping_data.get_observed_alleles(j, i);
+            std::vector<int> &latent =
+                latent_genotypes_[j * genotyping_data.num_samples + i];
+            for (int move = 0; move < latent_moves_per_update; move++)
+            {
+                const double log_proposal_ratio =
+                    propose_latent_move(latent, obs_genotype, m[i], ws);
+                if (log_proposal_ratio ==
+                    -std::numeric_limits<double>::infinity())
+                {
+                    break;
+                }
+
+                const double prop_llik = latent_genotype_llik(
+                    ws.latentProposal, obs_genotype, m[i], p[j], eps_neg[i],
+                    eps_pos[i], ws);
+                const double data_delta = prop_llik - llik_store_(j, i);
+                if (ws.sampler.sample_log_mh_acceptance() <=
+                    data_delta / temp + log_proposal_ratio)
                 {
-                    llik_old[j][i] = llik_new[j][i];
+                    latent.swap(ws.latentProposal);
+                    llik_store_(j, i) = prop_llik;
+                    llik_deltas_[i] += data_delta;
                 }
             }
         }
-    }
+    });
+    apply_llik_deltas();
 }
 
-std::vector<double> Chain::reweight_allele_frequencies(
-    std::vector<double> const &allele_frequencies,
-    std::vector<int> const &observed_genotype, double epsilon_neg,
-    double epsilon_pos, int coi)
+/*
+ * Proposes a move of latent_genotype into ws.latentProposal, returning the
+ * log of the ratio of the reverse to the forward proposal probabilities, -inf
+ * if no move is possible.
+ */
+double Chain::propose_latent_move(std::vector<int> const &latent_genotype,
+                                  AlleleSet const &obs_genotype, int coi,
+                                  Workspace &ws)
 {
-    std::vector<double> res(allele_frequencies.size(), 0);
-    std::vector<double> tp(allele_frequencies.size(), 0);
-    std::vector<double> fn(allele_frequencies.size(), 0);
-    double tp_sum = 0;
-    double fn_sum = 0;
+    const int total_alleles = obs_genotype.size();
+    const int size = latent_genotype.size();
+
+    // moves possible from a set of s alleles, adding, removing and swapping
+    const auto can_add = [&](int s) { return s < std::min(coi, total_alleles); };
+    const auto can_remove = [](int s) { return s > 1; };
+    const auto can_swap = [&](int s) { return s < total_alleles; };
+    const auto num_moves = [&](int s) {
+        return (int)can_add(s) + (int)can_remove(s) + (int)can_swap(s);
+    };
+
+    // log probability of adding allele to the set, which lacks it
+    const auto log_add_prob = [&](std::vector<int> const &set, int allele) {
+        int observed_in_set = 0;
+        for (const auto &a : set)
+        {
+            observed_in_set += obs_genotype[a];
+        }
+        const int missing = total_alleles - set.size();
+        const int observed_missing = obs_genotype.count() - observed_in_set;
+        if (observed_missing == 0)
+        {
+            return -std::log((double)missing);
+        }
+        return std::log(0.5 * obs_genotype[allele] / observed_missing +
+                        0.5 / missing);
+    };
+
+    // draws an allele missing from the set
+    const auto draw_addition = [&](std::vector<int> const &set) {
+        int observed_in_set = 0;
+        for (const auto &a : set)
+        {
+            observed_in_set += obs_genotype[a];
+        }
+        const int observed_missing = obs_genotype.count() - observed_in_set;
+        if (observed_missing > 0 && ws.sampler.runif_0_1() < 0.5)
+        {
+            int remaining = ws.sampler.sample_random_int(0, observed_missing - 1);
+            int res = -1;
+            obs_genotype.for_each([&](int allele) {
+                if (res < 0 &&
+                    !std::binary_search(set.begin(), set.end(), allele) &&
+                    remaining-- == 0)
+                {
+                    res = allele;
+                }
+            });
+            return res;
+        }
 
-    for (size_t i = 0; i < allele_frequencies.size(); i++)
+        // the k'th allele missing from the set, stepping over those in it
+        int res = ws.sampler.sample_random_int(0, total_alleles - set.size() - 1);
+        for (const auto &a : set)
+        {
+            if (a > res)
+            {
+                break;
+            }
+            res++;
+        }
+        return res;
+    };
+
+    const int moves = num_moves(size);
+    if (moves == 0)
+    {
+        return -std::numeric_limits<double>::infinity();
+    }
+    int move = ws.sampler.sample_random_int(0, moves - 1);
+    std::vector<int> &proposal = ws.latentProposal;
+    proposal = latent_genotype;
+
+    if (can_add(size) && move-- == 0)
+    {
+        const int added = draw_addition(latent_genotype);
+        proposal.insert(
+            std::lower_bound(proposal.begin(), proposal.end(), added), added);
+        return -std::log((double)num_moves(size + 1) * (size + 1)) -
+               (-std::log((double)moves) +
+                log_add_prob(latent_genotype, added));
+    }
+
+    const int removed_slot = ws.sampler.sample_random_int(0, size - 1);
+    const int removed = latent_genotype[removed_slot];
+    if (can_remove(size) && move-- == 0)
     {
-        if (observed_genotype[i])
+        proposal.erase(proposal.begin() + removed_slot);
+        return -std::log((double)num_moves(size - 1)) +
+               log_add_prob(proposal, removed) -
+               (-std::log((double)moves * size));
+    }
+
+    // swap, moves from either set are equally many
+    const int added = draw_addition(latent_genotype);
+    proposal.erase(proposal.begin() + removed_slot);
+    proposal.insert(std::lower_bound(proposal.begin(), proposal.end(), added),
+                    added);
+    return log_add_prob(proposal, removed) -
+           log_add_prob(latent_genotype, added);
+}
+
+/*
+ * Given the latent genotypes, a sample's likelihood depends on eps_neg only
+ * through eps_neg^fn (1 - eps_neg)^tn and on eps_pos only through
+ * eps_pos^fp (1 - eps_pos)^tp, counted over its loci. The Beta priors are
+ * conjugate, so each error rate is drawn from its truncated Beta conditional
+ * and always accepted.
+ */
+void Chain::update_eps_conjugate(int iteration, bool negative)
+{
+    reset_llik_deltas(genotyping_data.num_samples);
+    pool_->parallel_for(genotyping_data.num_samples, [&](size_t i, int t) {
+        Workspace &ws = seeded_workspace(
+            t, negative ? RandomStream::EpsNeg : RandomStream::EpsPos, i,
+            iteration);
+        double *proposed = llik_store_.spare(t);
+        std::fill(proposed, proposed + genotyping_data.num_loci, 0);
+
+        // errors and correct calls the rate being drawn governs
+        double errors = 0;
+        double correct = 0;
+        for (size_t j = 0; j < genotyping_data.num_loci; j++)
+        {
+            if (!genotyping_data.is_missing(j, i))
+            {
+                const ObservationCounts counts = count_observations(
+                    latent_genotypes_[j * genotyping_data.num_samples + i],
+                    genotyping_data.get_observed_alleles(j, i));
+                errors += negative ? counts.fn : counts.fp;
+                correct += negative ? counts.tn : counts.tp;
+            }
+        }
+
+        const double curr_eps = negative ? eps_neg[i] : eps_pos[i];
+        const double alpha = negative ? params.eps_neg_alpha
+                                      : params.eps_pos_alpha;
+        const double beta = negative ? params.eps_neg_beta
+                                     : params.eps_pos_beta;
+        const double log_beta = negative ? params.eps_neg_log_beta
+                                         : params.eps_pos_log_beta;
+        const double prop_eps = ws.sampler.sample_truncated_beta(
+            alpha + errors / temp, beta + correct / temp,
+            negative ? params.max_eps_neg : params.max_eps_pos);
+
+        // only the observation process changes, by the same terms per locus
+        const double log_error_ratio = std::log(prop_eps / curr_eps);
+        const double log_correct_ratio =
+            std::log((1 - prop_eps) / (1 - curr_eps));
+        double data_delta = 0;
+        for (size_t j = 0; j < genotyping_data.num_loci; j++)
+        {
+            if (!genotyping_data.is_missing(j, i))
+            {
+                const ObservationCounts counts = count_observations(
+                    latent_genotypes_[j * genotyping_data.num_samples + i],
+                    genotyping_data.get_observed_alleles(j, i));
+                const double delta =
+                    (negative ? counts.fn : counts.fp) * log_error_ratio +
+                    (negative ? counts.tn : counts.tp) * log_correct_ratio;
+                proposed[j] = llik_store_(j, i) + delta;
+                data_delta += delta;
+            }
+        }
+
+        const double prior_delta =
+            ws.sampler.get_epsilon_log_prior(prop_eps, alpha, beta, log_beta) -
+            ws.sampler.get_epsilon_log_prior(curr_eps, alpha, beta, log_beta);
+        llik_deltas_[i] =
+            untempered_delta(data_delta / temp + prior_delta, data_delta);
+        if (negative)
         {
-            tp[i] = allele_frequencies[i];
-            tp_sum += allele_frequencies[i];
+            eps_neg[i] = prop_eps;
+            eps_neg_accept[i] += 1;
         }
         else
         {
-            fn[i] = allele_frequencies[i];
-            fn_sum += allele_frequencies[i];
+            eps_pos[i] = prop_eps;
+            eps_pos_accept[i] += 1;
         }
-    }
+        llik_store_.accept_sample(i, t);
+    });
+    apply_llik_deltas();
+}
+
+/*
+ * Only the observed alleles are visited when summing, the frequencies sum to
+ * one so the unobserved mass is what remains.
+ */
+void Chain::reweight_allele_frequencies(
+    std::vector<double> const &allele_frequencies,
+    AlleleSet const &observed_genotype, double epsilon_neg,
+    double epsilon_pos, int coi, std::vector<double> &res)
+{
+    double tp_sum = 0;
+    observed_genotype.for_each(
+        [&](int allele) { tp_sum += allele_frequencies[allele]; });
+    double fn_sum = 1 - tp_sum;
 
     double inv_tp_sum = 1.0 / tp_sum;
     double inv_fn_sum = 1.0 / fn_sum;
@@ -458,27 +1143,19 @@ std::vector<double> Chain::reweight_allele_frequencies(
     double obs_pos_mass = inv_tp_sum * prop_pos;
     double obs_neg_mass = inv_fn_sum * prop_neg;
 
-    // double obs_pos_mass = inv_tp_sum * .9;
-    // double obs_neg_mass = inv_fn_sum * .1;
-
+    res.resize(allele_frequencies.size());
     for (size_t i = 0; i < allele_frequencies.size(); i++)
     {
-        if (observed_genotype[i])
-        {
-            res[i] += tp[i] * obs_pos_mass;
-        }
-        else
-        {
-            res[i] += fn[i] * obs_neg_mass;
-        }
+        res[i] = allele_frequencies[i] * obs_neg_mass;
     }
-
-    return res;
+    observed_genotype.for_each([&](int allele) {
+        res[allele] = allele_frequencies[allele] * obs_pos_mass;
+    });
 }
 
 double Chain::calc_transmission_process(
     std::vector<int> const &allele_index_vec,
-    std::vector<double> const &allele_frequencies, int coi)
+    std::vector<double> const &allele_frequencies, int coi, Workspace &ws)
 {
     // transmission process - prob that after "coi" number of draws, all
     // alleles are drawn at least once conditional on all draws come
@@ -486,80 +1163,45 @@ double Chain::calc_transmission_process(
     // positive alleles in the latent genotype
 
     double constrained_set_total_prob = 0;
-    double res = 0;
-    prVec_.clear();
-    prVec_.reserve(allele_index_vec.size());
+    ws.prVec.clear();
+    ws.prVec.reserve(allele_index_vec.size());
 
     for (size_t j = 0; j < allele_index_vec.size(); j++)
     {
-        prVec_.push_back(allele_frequencies[allele_index_vec[j]]);
-        constrained_set_total_prob += prVec_.back();
+        ws.prVec.push_back(allele_frequencies[allele_index_vec[j]]);
+        constrained_set_total_prob += ws.prVec.back();
     }
 
-    // normalize the vector
-    for (double &k : prVec_)
-    {
-        k = k / constrained_set_total_prob;
-    }
-
-    res = std::log(1 - probAnyMissing_(prVec_, coi)) +
-          log(constrained_set_total_prob) * coi;
+    double res = std::log(
+        ws.probAnyMissing.allDrawn(ws.prVec, constrained_set_total_prob, coi));
 
     return res;
 }
 
 double Chain::calc_observation_process(std::vector<int> const &allele_index_vec,
-                                       std::vector<int> const &obs_genotype,
-                                       int coi, double epsilon_neg,
-                                       double epsilon_pos)
+                                       AlleleSet const &obs_genotype, int coi,
+                                       double epsilon_neg, double epsilon_pos)
 {
     double res = 0;
-    int fp = 0;
-    int tp = 0;
-    int fn = 0;
-    int tn = 0;
-
-    int vec_pointer = 0;
-    int next_allele_index = allele_index_vec[vec_pointer];
-
-    // for (size_t j = 0; j < total_alleles; j++)
-    int j = 0;
-    bool is_allele;
-    for (const auto &e : obs_genotype)
-    {
-        is_allele = (j == next_allele_index);
-        fp += e == 1 and !is_allele;
-        tp += e == 1 and is_allele;
-        fn += e == 0 and is_allele;
-        tn += e == 0 and !is_allele;
-        vec_pointer += is_allele;
-
-        if (vec_pointer < coi)
-        {
-            next_allele_index = allele_index_vec[vec_pointer];
-        }
-        else
-        {
-            next_allele_index = -1;
-        }
-        ++j;
-    }
+    const ObservationCounts counts =
+        count_observations(allele_index_vec, obs_genotype);
 
-    res += std::log(epsilon_neg) * fn;
-    res += std::log(1 - epsilon_neg) * tn;
-    res += std::log(epsilon_pos) * fp;
-    res += std::log(1 - epsilon_pos) * tp;
+    res += std::log(epsilon_neg) * counts.fn;
+    res += std::log(1 - epsilon_neg) * counts.tn;
+    res += std::log(epsilon_pos) * counts.fp;
+    res += std::log(1 - epsilon_pos) * counts.tp;
 
     return res;
 };
 
 double Chain::calc_genotype_log_pmf(
-    std::vector<int> const &allele_index_vec,
-    std::vector<int> const &obs_genotype, double epsilon_pos,
-    double epsilon_neg, int coi, std::vector<double> const &allele_frequencies)
+    std::vector<int> const &allele_index_vec, AlleleSet const &obs_genotype,
+    double epsilon_pos, double epsilon_neg, int coi,
+    std::vector<double> const &allele_frequencies, Workspace &ws)
 {
     double res = 0.0;
-    res += calc_transmission_process(allele_index_vec, allele_frequencies, coi);
+    res += calc_transmission_process(allele_index_vec, allele_frequencies, coi,
+                                     ws);
 
     res += calc_observation_process(allele_index_vec, obs_genotype, coi,
                                     epsilon_neg, epsilon_pos);
@@ -567,179 +1209,1103 @@ double Chain::calc_genotype_log_pmf(
     return res;
 }
 
+/*
+ * Exact marginal by enumerating every latent genotype of size 1..coi.
+ *
+ * Genotypes of each size are visited in revolving door order, so consecutive
+ * genotypes differ by one allele leaving and one entering. The constrained set
+ * probability and the observation counts are updated in O(1) per genotype
+ * rather than recomputed, leaving only the inclusion-exclusion over the
+ * genotype's alleles.
+ */
 long double Chain::calc_exact_genotype_marginal_llik(
-    std::vector<int> const &obs_genotype, int coi,
+    AlleleSet const &obs_genotype, int coi,
     std::vector<double> const &allele_frequencies, double epsilon_neg,
-    double epsilon_pos)
+    double epsilon_pos, Workspace &ws)
 {
+    const int total_alleles = allele_frequencies.size();
+    const int total_obs = obs_genotype.count();
+
+    // matches the error model in calc_observation_process
+    const double log_tp = std::log(1 - epsilon_pos);
+    const double log_fp = std::log(epsilon_pos);
+    const double log_fn = std::log(epsilon_neg);
+    const double log_tn = std::log(1 - epsilon_neg);
+
+    RevolvingDoorGenerator &gen = ws.allele_index_generator;
+    ws.prSlot.resize(total_alleles);
+
     long double res = 0;
-    double total_samples = 0;
     for (int i = 1; i <= coi; i++)
     {
-        Rcpp::checkUserInterrupt();
-        allele_index_generator_.reset(allele_frequencies.size(), i);
-        while (!allele_index_generator_.completed)
+        gen.reset(total_alleles, i);
+        if (gen.completed)
         {
-            total_samples++;
-            
-            res += std::exp(calc_genotype_log_pmf(
-                allele_index_generator_.curr, obs_genotype, epsilon_pos,
-                epsilon_neg, coi, allele_frequencies));
-            allele_index_generator_.next();
+            break;
         }
-    }
-    return log(res);
-}
 
-long double Chain::calc_estimated_genotype_marginal_llik(
-    std::vector<int> const &obs_genotype,
-    std::vector<int> const &emphasized_alleles, int coi,
+        // prVec holds the frequencies of the latent alleles, in no particular
+        // order, and prSlot maps a latent allele to its position in prVec
+        double constrained_set_total_prob = 0;
+        int tp = 0;
+        ws.prVec.resize(i);
+        for (int k = 0; k < i; k++)
+        {
+            const int allele = gen.curr[k];
+            ws.prVec[k] = allele_frequencies[allele];
+            ws.prSlot[allele] = k;
+            constrained_set_total_prob += ws.prVec[k];
+            tp += obs_genotype[allele];
+        }
+
+        while (!gen.completed)
+        {
+            const int fp = total_obs - tp;
+            const int fn = i - tp;
+            const int tn = total_alleles - i - fp;
+            const double obs_llik =
+                log_tp * tp + log_fp * fp + log_fn * fn + log_tn * tn;
+
+            res += ws.probAnyMissing.allDrawn(ws.prVec,
+                                              constrained_set_total_prob, coi) *
+                   std::exp(obs_llik);
+
+            gen.next();
+            if (gen.completed)
+            {
+                break;
+            }
+
+            const int slot = ws.prSlot[gen.removed];
+            ws.prVec[slot] = allele_frequencies[gen.added];
+            ws.prSlot[gen.added] = slot;
+            constrained_set_total_prob += allele_frequencies[gen.added] -
+                                          allele_frequencies[gen.removed];
+            tp += obs_genotype[gen.added] - obs_genotype[gen.removed];
+        }
+    }
+    return log(res);
+}
+
+/*
+ * calc_exact_genotype_marginal_llik at each of cois, ascending, in one
+ * enumeration. Every latent genotype's constrained set probability and
+ * observation likelihood are computed once, and the inclusion-exclusion over
+ * its alleles is shared by the COIs it can be drawn in.
+ */
+void Chain::calc_exact_genotype_marginal_lliks(
+    AlleleSet const &obs_genotype, std::vector<int> const &cois,
     std::vector<double> const &allele_frequencies, double epsilon_neg,
-    double epsilon_pos, int sampling_depth)
+    double epsilon_pos, Workspace &ws, std::vector<double> &res)
+{
+    const int total_alleles = allele_frequencies.size();
+    const int total_obs = obs_genotype.count();
+    const size_t num_cois = cois.size();
+
+    const double log_tp = std::log(1 - epsilon_pos);
+    const double log_fp = std::log(epsilon_pos);
+    const double log_fn = std::log(epsilon_neg);
+    const double log_tn = std::log(1 - epsilon_neg);
+
+    RevolvingDoorGenerator &gen = ws.allele_index_generator;
+    ws.prSlot.resize(total_alleles);
+    std::vector<long double> &sums = ws.enumSums;
+    sums.assign(num_cois, 0);
+
+    for (int i = 1; i <= cois.back(); i++)
+    {
+        gen.reset(total_alleles, i);
+        if (gen.completed)
+        {
+            break;
+        }
+
+        double constrained_set_total_prob = 0;
+        int tp = 0;
+        ws.prVec.resize(i);
+        for (int k = 0; k < i; k++)
+        {
+            const int allele = gen.curr[k];
+            ws.prVec[k] = allele_frequencies[allele];
+            ws.prSlot[allele] = k;
+            constrained_set_total_prob += ws.prVec[k];
+            tp += obs_genotype[allele];
+        }
+
+        while (!gen.completed)
+        {
+            const int fp = total_obs - tp;
+            const int fn = i - tp;
+            const int tn = total_alleles - i - fp;
+            const double obs_lik = std::exp(log_tp * tp + log_fp * fp +
+                                            log_fn * fn + log_tn * tn);
+
+            ws.probAnyMissing.allDrawn(ws.prVec, constrained_set_total_prob,
+                                       cois, ws.drawnProbs);
+            for (size_t c = 0; c < num_cois; c++)
+            {
+                if (cois[c] >= i)
+                {
+                    sums[c] += ws.drawnProbs[c] * obs_lik;
+                }
+            }
+
+            gen.next();
+            if (gen.completed)
+            {
+                break;
+            }
+
+            const int slot = ws.prSlot[gen.removed];
+            ws.prVec[slot] = allele_frequencies[gen.added];
+            ws.prSlot[gen.added] = slot;
+            constrained_set_total_prob += allele_frequencies[gen.added] -
+                                          allele_frequencies[gen.removed];
+            tp += obs_genotype[gen.added] - obs_genotype[gen.removed];
+        }
+    }
+
+    res.resize(num_cois);
+    for (size_t c = 0; c < num_cois; c++)
+    {
+        res[c] = log(sums[c]);
+    }
+}
+
+/*
+ * Exact marginal over latent genotypes in O(K * coi^2).
+ *
+ * Each allele is either never drawn or drawn at least once across the coi
+ * draws, so the probability of observing obs_genotype is
+ *     coi! [x^coi] prod_k (f0_k + f1_k (exp(p_k x) - 1))
+ * where f0_k/f1_k are the observation probabilities of allele k when it is
+ * absent/present in the latent genotype. All terms are non-negative, so the
+ * coefficient is accumulated allele by allele without cancellation.
+ */
+long double Chain::calc_dp_genotype_marginal_llik(
+    AlleleSet const &obs_genotype, int coi,
+    std::vector<double> const &allele_frequencies, double epsilon_neg,
+    double epsilon_pos, Workspace &ws)
+{
+    calc_dp_coefficients(obs_genotype, coi, allele_frequencies, epsilon_neg,
+                         epsilon_pos, ws);
+    return std::log(ws.dpVec[coi]) + lookup.log_factorial(coi);
+}
+
+/*
+ * Leaves [x^d] of the product above in ws.dpVec[d] for every d up to
+ * max_coi. Each coefficient only depends on those of lower degree, so one
+ * pass gives the marginals of every COI up to max_coi.
+ */
+void Chain::calc_dp_coefficients(AlleleSet const &obs_genotype, int max_coi,
+                                 std::vector<double> const &allele_frequencies,
+                                 double epsilon_neg, double epsilon_pos,
+                                 Workspace &ws)
+{
+    const int coi = max_coi;
+    ws.dpVec.assign(coi + 1, 0);
+    ws.dpPow.resize(coi + 1);
+    ws.dpVec[0] = 1;
+
+    // matches the error model in calc_observation_process, every unobserved
+    // allele shares the first pair
+    const long double absent_f0 = 1 - epsilon_neg;
+    const long double absent_f1 = epsilon_neg;
+    const long double observed_f0 = epsilon_pos;
+    const long double observed_f1 = 1 - epsilon_pos;
+
+    obs_genotype.for_all([&](int k, bool observed) {
+        const long double f0 = observed ? observed_f0 : absent_f0;
+        const long double f1 = observed ? observed_f1 : absent_f1;
+
+        // dpPow[d] = p^d / d!
+        ws.dpPow[0] = 1;
+        for (int d = 1; d <= coi; d++)
+        {
+            ws.dpPow[d] = ws.dpPow[d - 1] * allele_frequencies[k] / d;
+        }
+
+        // descending so that dpVec[d - r] still holds the previous allele
+        for (int d = coi; d >= 0; d--)
+        {
+            long double drawn = 0;
+            for (int r = 1; r <= d; r++)
+            {
+                drawn += ws.dpPow[r] * ws.dpVec[d - r];
+            }
+            ws.dpVec[d] = f0 * ws.dpVec[d] + f1 * drawn;
+        }
+    });
+}
+
+long double Chain::calc_estimated_genotype_marginal_llik(
+    AlleleSet const &obs_genotype,
+    AlleleSet const &emphasized_alleles, int coi,
+    std::vector<double> const &allele_frequencies, double epsilon_neg,
+    double epsilon_pos, int sampling_depth, Workspace &ws)
 {
     int i = sampling_depth;
     double importance_weight = 0;
 
-    std::vector<int> allele_index_vec;
-    std::vector<double> reweighted_allele_frequencies =
-        reweight_allele_frequencies(allele_frequencies, emphasized_alleles,
-                                    epsilon_neg, epsilon_pos, coi);
+    // all scratch lives in the workspace so repeated proposals reuse it
+    std::vector<int> &allele_index_vec = ws.latentIndices;
+    std::vector<double> &reweighted_allele_frequencies = ws.reweightedFreqs;
+    reweight_allele_frequencies(allele_frequencies, emphasized_alleles,
+                                epsilon_neg, epsilon_pos, coi,
+                                reweighted_allele_frequencies);
 
     double est = 0.0;
+    double est_sq = 0.0;
     double val = 0.0;
-    std::map<std::vector<int>, double> memo{};
+
+    const int num_words = obs_genotype.num_words();
+    ws.latentKey.resize(num_words);
+    AlleleSet::word_t *key = ws.latentKey.data();
+    ws.latent_memo.reset(num_words, sampling_depth);
+    ws.sampler.set_latent_allele_frequencies(reweighted_allele_frequencies);
 
     while (--i >= 0)
     {
-        allele_index_vec =
-            sampler.sample_latent_genotype(coi, reweighted_allele_frequencies);
-        auto s = memo.find(allele_index_vec);
-        if (s != memo.end())
+        ws.sampler.sample_latent_genotype(coi, allele_index_vec);
+
+        std::fill(key, key + num_words, 0);
+        for (const auto &allele : allele_index_vec)
         {
-            val = s->second;
+            AlleleSet::set(key, allele);
+        }
+
+        const double *s = ws.latent_memo.find(key);
+        if (params.profile)
+        {
+            ws.profile.latent_memo.record(s != nullptr);
+        }
+        if (s != nullptr)
+        {
+            val = *s;
         }
         else
         {
             importance_weight = calc_transmission_process(
-                allele_index_vec, reweighted_allele_frequencies, coi);
+                allele_index_vec, reweighted_allele_frequencies, coi, ws);
             val = std::exp(calc_genotype_log_pmf(allele_index_vec, obs_genotype,
                                                  epsilon_pos, epsilon_neg, coi,
-                                                 allele_frequencies) -
+                                                 allele_frequencies, ws) -
                            importance_weight);
-            memo[allele_index_vec] = val;
+            ws.latent_memo.insert(key, val);
         }
         est += val;
+        est_sq += val * val;
     }
 
+    record_importance_sampling_error(est, est_sq, sampling_depth,
+                                     est / sampling_depth, ws);
+
     est = std::log(est / sampling_depth);
     return est;
 }
 
-long double Chain::calc_genotype_marginal_llik(
-    std::vector<int> const &obs_genotype,
-    std::vector<int> const &emphasized_alleles, int coi,
+/*
+ * Importance sampling estimate with three variance reductions.
+ *
+ * Latent sets are stratified by size: every set of at most low_order alleles
+ * is enumerated exactly, spending up to a quarter of the sampling budget, so
+ * the sampled estimate only covers the larger sets. The enumeration also gives
+ * the proposal's mass on the small sets, which is removed from draws that
+ * land there rather than estimated, the exact stratum acting as a control
+ * variate with a known mean. The remaining draws come from a randomized
+ * Halton sequence instead of independent uniforms, which keeps the estimate
+ * unbiased while spreading the latent sets more evenly over the proposal,
+ * and the proposal is flattened over the observed alleles.
+ */
+long double Chain::calc_variance_reduced_genotype_marginal_llik(
+    AlleleSet const &obs_genotype,
+    AlleleSet const &emphasized_alleles, int coi,
     std::vector<double> const &allele_frequencies, double epsilon_neg,
-    double epsilon_pos)
+    double epsilon_pos, int sampling_depth, Workspace &ws)
 {
-    double log_total_combinations =
-        lookup.get_sampling_depth(coi, allele_frequencies.size());
+    const int total_alleles = allele_frequencies.size();
+    const int max_size = std::min(coi, total_alleles);
+
+    std::vector<int> &allele_index_vec = ws.latentIndices;
+    std::vector<double> &reweighted_allele_frequencies = ws.reweightedFreqs;
+    reweight_allele_frequencies(allele_frequencies, emphasized_alleles,
+                                epsilon_neg, epsilon_pos, coi,
+                                reweighted_allele_frequencies);
+
+    // nearly every likely latent set holds all the observed alleles, flatten
+    // the proposal over them so rare observed alleles are still drawn
+    double observed_mass = 0;
+    double flattened_mass = 0;
+    emphasized_alleles.for_each([&](int k) {
+        observed_mass += reweighted_allele_frequencies[k];
+        flattened_mass += std::sqrt(allele_frequencies[k]);
+    });
+    emphasized_alleles.for_each([&](int k) {
+        reweighted_allele_frequencies[k] =
+            observed_mass * std::sqrt(allele_frequencies[k]) / flattened_mass;
+    });
+
+    // largest set size whose strata fit in a quarter of the budget
+    int low_order = 0;
+    double total_enumerated = 0;
+    double num_combinations = 1;
+    while (low_order < max_size)
+    {
+        num_combinations =
+            num_combinations * (total_alleles - low_order) / (low_order + 1);
+        if (total_enumerated + num_combinations > sampling_depth / 4.0)
+        {
+            break;
+        }
+        total_enumerated += num_combinations;
+        low_order++;
+    }
+
+    long double exact_mass = 0;
+    double proposal_mass = 0;
+    RevolvingDoorGenerator &gen = ws.allele_index_generator;
+    for (int i = 1; i <= low_order; i++)
+    {
+        for (gen.reset(total_alleles, i); !gen.completed; gen.next())
+        {
+            exact_mass += std::exp(calc_genotype_log_pmf(
+                gen.curr, obs_genotype, epsilon_pos, epsilon_neg, coi,
+                allele_frequencies, ws));
+            proposal_mass += std::exp(calc_transmission_process(
+                gen.curr, reweighted_allele_frequencies, coi, ws));
+        }
+    }
 
+    if (low_order == max_size)
+    {
+        return std::log(exact_mass);
+    }
+
+    const int num_draws = std::max(1, sampling_depth - (int)total_enumerated);
+    const double sampled_mass = std::max(0.0, 1 - proposal_mass);
+
+    const int num_words = obs_genotype.num_words();
+    ws.latentKey.resize(num_words);
+    AlleleSet::word_t *key = ws.latentKey.data();
+    ws.latent_memo.reset(num_words, num_draws);
+    ws.halton.reset(coi, ws.sampler);
+    ws.sampler.set_latent_allele_frequencies(reweighted_allele_frequencies);
+
+    double est = 0.0;
+    double est_sq = 0.0;
+    double val = 0.0;
+    int num_accepted = 0;
+    for (int i = 0; i < num_draws; i++)
+    {
+        const std::vector<double> &u = ws.halton.next(ws.sampler);
+        ws.sampler.sample_latent_genotype(coi, u.data(), allele_index_vec);
+
+        // already counted exactly
+        if ((int)allele_index_vec.size() <= low_order)
+        {
+            continue;
+        }
+
+        std::fill(key, key + num_words, 0);
+        for (const auto &allele : allele_index_vec)
+        {
+            AlleleSet::set(key, allele);
+        }
+
+        const double *s = ws.latent_memo.find(key);
+        if (params.profile)
+        {
+            ws.profile.latent_memo.record(s != nullptr);
+        }
+        if (s != nullptr)
+        {
+            val = *s;
+        }
+        else
+        {
+            const double importance_weight = calc_transmission_process(
+                allele_index_vec, reweighted_allele_frequencies, coi, ws);
+            val = std::exp(calc_genotype_log_pmf(allele_index_vec, obs_genotype,
+                                                 epsilon_pos, epsilon_neg, coi,
+                                                 allele_frequencies, ws) -
+                           importance_weight);
+            ws.latent_memo.insert(key, val);
+        }
+        est += val;
+        est_sq += val * val;
+        num_accepted++;
+    }
+
+    long double res = exact_mass;
+    if (num_accepted > 0)
+    {
+        // draws conditioned on landing outside the exact strata are weighted
+        // by the proposal mass left there
+        res += sampled_mass * est / num_accepted;
+        record_importance_sampling_error(
+            est * sampled_mass, est_sq * sampled_mass * sampled_mass,
+            num_accepted, res, ws);
+    }
+    return std::log(res);
+}
+
+/*
+ * Accumulate the relative standard error of an importance sampled marginal
+ * with value estimate, sum and sum_sq being the sums of its n sampled weights
+ * and their squares. Under quasi Monte Carlo draws the sample variance
+ * overstates the error.
+ */
+void Chain::record_importance_sampling_error(double sum, double sum_sq,
+                                             int n, double estimate,
+                                             Workspace &ws)
+{
+    if (n < 2 || estimate <= 0)
+    {
+        return;
+    }
+    const double mean = sum / n;
+    const double var = std::max(0.0, (sum_sq - n * mean * mean) / (n - 1));
+    ws.is_error_sum += std::sqrt(var / n) / estimate;
+    ws.is_error_calls++;
+}
+
+double Chain::get_importance_sampling_error() const
+{
+    double error_sum = 0;
+    long calls = 0;
+    for (const auto &ws : workspaces_)
+    {
+        error_sum += ws.is_error_sum;
+        calls += ws.is_error_calls;
+    }
+    if (calls == 0)
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return error_sum / calls;
+}
+
+void Chain::write_state(CheckpointWriter &out) const
+{
+    out.write((int32_t)chain_id_);
+    out.write(temp);
+    out.write(mean_coi);
+    out.write(llik);
+    out.write(m);
+    out.write(eps_neg);
+    out.write(eps_pos);
+    for (const auto &locus_freqs : p)
+    {
+        out.write(locus_freqs);
+    }
+
+    out.write(m_accept);
+    out.write(p_accept);
+    out.write(eps_neg_accept);
+    out.write(eps_pos_accept);
+    out.write(individual_accept);
+
+    out.write((int32_t)adapting_);
+    out.write(mean_coi_var);
+    out.write(m_prop_mean);
+    out.write(p_prop_var);
+    out.write(eps_neg_var);
+    out.write(eps_pos_var);
+
+    std::vector<double> marginals(genotyping_data.num_loci *
+                                  genotyping_data.num_samples);
+    for (size_t i = 0; i < genotyping_data.num_samples; i++)
+    {
+        for (size_t j = 0; j < genotyping_data.num_loci; j++)
+        {
+            marginals[i * genotyping_data.num_loci + j] = llik_store_(j, i);
+        }
+    }
+    out.write(marginals);
+
+    double error_sum = 0;
+    int64_t error_calls = 0;
+    for (const auto &ws : workspaces_)
+    {
+        error_sum += ws.is_error_sum;
+        error_calls += ws.is_error_calls;
+    }
+    out.write(error_sum);
+    out.write(error_calls);
+
+    if (augmented())
+    {
+        std::vector<int> latent_sizes{};
+        std::vector<int> latent_alleles{};
+        for (const auto &latent : latent_genotypes_)
+        {
+            latent_sizes.push_back(latent.size());
+            latent_alleles.insert(latent_alleles.end(), latent.begin(),
+                                  latent.end());
+        }
+        out.write(latent_sizes);
+        out.write(latent_alleles);
+    }
+}
+
+void Chain::read_state(CheckpointReader &in)
+{
+    chain_id_ = in.read<int32_t>();
+    temp = in.read<double>();
+    mean_coi = in.read<double>();
+    llik = in.read<double>();
+    in.read(m);
+    in.read(eps_neg);
+    in.read(eps_pos);
+    for (auto &locus_freqs : p)
+    {
+        in.read(locus_freqs);
+    }
+
+    in.read(m_accept);
+    in.read(p_accept);
+    in.read(eps_neg_accept);
+    in.read(eps_pos_accept);
+    in.read(individual_accept);
+
+    adapting_ = in.read<int32_t>();
+    mean_coi_var = in.read<double>();
+    in.read(m_prop_mean);
+    in.read(p_prop_var);
+    in.read(eps_neg_var);
+    in.read(eps_pos_var);
+
+    std::vector<double> marginals(genotyping_data.num_loci *
+                                  genotyping_data.num_samples);
+    in.read(marginals);
+    for (size_t i = 0; i < genotyping_data.num_samples; i++)
+    {
+        for (size_t j = 0; j < genotyping_data.num_loci; j++)
+        {
+            llik_store_(j, i) = marginals[i * genotyping_data.num_loci + j];
+        }
+    }
+
+    // the cache holds marginals of the initial state
+    marginal_cache_.resize(genotyping_data.num_loci,
+                           genotyping_data.num_samples);
+
+    for (auto &ws : workspaces_)
+    {
+        ws.is_error_sum = 0;
+        ws.is_error_calls = 0;
+    }
+    workspaces_[0].is_error_sum = in.read<double>();
+    workspaces_[0].is_error_calls = in.read<int64_t>();
+
+    if (augmented())
+    {
+        std::vector<int> latent_sizes(latent_genotypes_.size());
+        in.read(latent_sizes);
+        size_t total_alleles = 0;
+        for (const auto &size : latent_sizes)
+        {
+            total_alleles += size;
+        }
+        std::vector<int> latent_alleles(total_alleles);
+        in.read(latent_alleles);
+
+        auto allele = latent_alleles.begin();
+        for (size_t k = 0; k < latent_genotypes_.size(); k++)
+        {
+            latent_genotypes_[k].assign(allele, allele + latent_sizes[k]);
+            allele += latent_sizes[k];
+        }
+    }
+}
+
+MarginalMethod Chain::resolve_marginal_method(int coi, int num_alleles)
+{
+    switch (params.marginal_method)
+    {
+        case MarginalMethod::DynamicProgramming:
+        case MarginalMethod::ImportanceSampling:
+        case MarginalMethod::DataAugmentation:
+            return params.marginal_method;
+        case MarginalMethod::Auto:
+        case MarginalMethod::Enumeration:
+            break;
+    }
+
+    // both costs in inner loop terms, see Lookup::get_enumeration_cost. The
+    // DP accumulates d terms for each degree d <= coi of every allele, after
+    // setting up the allele's powers and error terms
+    if (params.marginal_method == MarginalMethod::Auto)
+    {
+        constexpr double dp_allele_cost = 6;
+        const double log_enumeration_cost =
+            lookup.get_enumeration_cost(coi, num_alleles);
+        const double log_dp_cost = std::log(
+            num_alleles * (dp_allele_cost + (coi + 1.0) * (coi + 2.0) / 2));
+        if (log_enumeration_cost <= log_dp_cost)
+        {
+            return MarginalMethod::Enumeration;
+        }
+        return MarginalMethod::DynamicProgramming;
+    }
+
+    double log_total_combinations = lookup.get_sampling_depth(coi, num_alleles);
 
     if (log_total_combinations <= std::log(params.complexity_limit))
     {
-        return calc_exact_genotype_marginal_llik(
-            obs_genotype, coi, allele_frequencies, epsilon_neg, epsilon_pos);
+        return MarginalMethod::Enumeration;
     }
-    else
+    return MarginalMethod::ImportanceSampling;
+}
+
+void Chain::record_marginal(MarginalMethod method, int coi, int num_alleles,
+                            Workspace &ws)
+{
+    if (!params.profile)
     {
-        double approx = calc_estimated_genotype_marginal_llik(
-            obs_genotype, emphasized_alleles, coi, allele_frequencies,
-            epsilon_neg, epsilon_pos,
-            params.importance_sampling_depth +
-                coi * params.importance_sampling_scaling_factor);
+        return;
+    }
 
-        return approx;
+    switch (method)
+    {
+        case MarginalMethod::DynamicProgramming:
+            ws.profile.dynamic_programming.record(coi, num_alleles);
+            break;
+        case MarginalMethod::Enumeration:
+            ws.profile.enumeration.record(coi, num_alleles);
+            break;
+        case MarginalMethod::ImportanceSampling:
+            ws.profile.importance_sampling.record(coi, num_alleles);
+            break;
+        case MarginalMethod::Auto:
+        case MarginalMethod::DataAugmentation:
+            break;
     }
 }
 
+bool Chain::is_cacheable(int coi, int num_alleles)
+{
+    switch (resolve_marginal_method(coi, num_alleles))
+    {
+        case MarginalMethod::DynamicProgramming:
+        case MarginalMethod::Enumeration:
+            return true;
+        case MarginalMethod::Auto:
+        case MarginalMethod::ImportanceSampling:
+        case MarginalMethod::DataAugmentation:
+            break;
+    }
+    return false;
+}
+
+long double Chain::calc_genotype_marginal_llik(
+    AlleleSet const &obs_genotype,
+    AlleleSet const &emphasized_alleles, int coi,
+    std::vector<double> const &allele_frequencies, double epsilon_neg,
+    double epsilon_pos, Workspace &ws)
+{
+    const MarginalMethod method =
+        resolve_marginal_method(coi, allele_frequencies.size());
+    record_marginal(method, coi, allele_frequencies.size(), ws);
+    switch (method)
+    {
+        case MarginalMethod::DynamicProgramming:
+            return calc_dp_genotype_marginal_llik(
+                obs_genotype, coi, allele_frequencies, epsilon_neg, epsilon_pos,
+                ws);
+        case MarginalMethod::Enumeration:
+            return calc_exact_genotype_marginal_llik(
+                obs_genotype, coi, allele_frequencies, epsilon_neg, epsilon_pos,
+                ws);
+        case MarginalMethod::Auto:
+        case MarginalMethod::ImportanceSampling:
+        case MarginalMethod::DataAugmentation:
+            break;
+    }
+
+    const int sampling_depth = params.importance_sampling_depth +
+                               coi * params.importance_sampling_scaling_factor;
+
+    if (params.importance_sampler == ImportanceSampler::VarianceReduced)
+    {
+        return calc_variance_reduced_genotype_marginal_llik(
+            obs_genotype, emphasized_alleles, coi, allele_frequencies,
+            epsilon_neg, epsilon_pos, sampling_depth, ws);
+    }
+
+    double approx = calc_estimated_genotype_marginal_llik(
+        obs_genotype, emphasized_alleles, coi, allele_frequencies, epsilon_neg,
+        epsilon_pos, sampling_depth, ws);
+
+    return approx;
+}
+
 long double Chain::calc_genotype_marginal_llik(
-    std::vector<int> const &obs_genotype, int coi,
+    AlleleSet const &obs_genotype, int coi,
     std::vector<double> const &allele_frequencies, double epsilon_neg,
-    double epsilon_pos)
+    double epsilon_pos, Workspace &ws)
 {
     return calc_genotype_marginal_llik(obs_genotype, obs_genotype, coi,
                                        allele_frequencies, epsilon_neg,
-                                       epsilon_pos);
+                                       epsilon_pos, ws);
 }
 
-void Chain::initialize_likelihood()
+/*
+ * Marginals at each of cois, ascending and distinct, equal to those of
+ * calc_genotype_marginal_llik. The COIs computed by dynamic programming
+ * share one pass up to the largest of them and those enumerated share one
+ * enumeration; importance sampled ones are estimated one at a time.
+ */
+void Chain::calc_genotype_marginal_lliks(
+    AlleleSet const &obs_genotype, std::vector<int> const &cois,
+    std::vector<double> const &allele_frequencies, double epsilon_neg,
+    double epsilon_pos, Workspace &ws, std::vector<double> &res)
 {
-    for (size_t j = 0; j < genotyping_data.num_loci; j++)
+    const size_t num_cois = cois.size();
+    res.resize(num_cois);
+    ws.enumCois.clear();
+    int max_dp_coi = 0;
+    for (size_t c = 0; c < num_cois; c++)
     {
-        llik_old.push_back(std::vector<double>(genotyping_data.num_samples));
-        llik_new.push_back(std::vector<double>(genotyping_data.num_samples));
-        for (size_t i = 0; i < genotyping_data.num_samples; i++)
+        switch (resolve_marginal_method(cois[c], allele_frequencies.size()))
         {
-            double marginal_llik = 0;
-            if (!genotyping_data.is_missing(j, i))
+            case MarginalMethod::DynamicProgramming:
+                max_dp_coi = cois[c];
+                break;
+            case MarginalMethod::Enumeration:
+                ws.enumCois.push_back(cois[c]);
+                break;
+            case MarginalMethod::Auto:
+            case MarginalMethod::ImportanceSampling:
+            case MarginalMethod::DataAugmentation:
+                res[c] = calc_genotype_marginal_llik(
+                    obs_genotype, cois[c], allele_frequencies, epsilon_neg,
+                    epsilon_pos, ws);
+                break;
+        }
+    }
+
+    if (!ws.enumCois.empty())
+    {
+        calc_exact_genotype_marginal_lliks(obs_genotype, ws.enumCois,
+                                           allele_frequencies, epsilon_neg,
+                                           epsilon_pos, ws, ws.enumLliks);
+    }
+    if (max_dp_coi > 0)
+    {
+        calc_dp_coefficients(obs_genotype, max_dp_coi, allele_frequencies,
+                             epsilon_neg, epsilon_pos, ws);
+    }
+
+    // importance sampled marginals were counted as they were estimated
+    size_t enumerated = 0;
+    for (size_t c = 0; c < num_cois; c++)
+    {
+        const MarginalMethod method =
+            resolve_marginal_method(cois[c], allele_frequencies.size());
+        switch (method)
+        {
+            case MarginalMethod::DynamicProgramming:
+                record_marginal(method, cois[c], allele_frequencies.size(), ws);
+                res[c] = std::log(ws.dpVec[cois[c]]) +
+                         lookup.log_factorial(cois[c]);
+                break;
+            case MarginalMethod::Enumeration:
+                record_marginal(method, cois[c], allele_frequencies.size(), ws);
+                res[c] = ws.enumLliks[enumerated++];
+                break;
+            case MarginalMethod::Auto:
+            case MarginalMethod::ImportanceSampling:
+            case MarginalMethod::DataAugmentation:
+                break;
+        }
+    }
+}
+
+double Chain::genotype_llik(size_t j, size_t i, int coi,
+                            std::vector<double> const &allele_frequencies,
+                            double epsilon_neg, double epsilon_pos,
+                            Workspace &ws)
+{
+    if (augmented())
+    {
+        return latent_genotype_llik(
+            latent_genotypes_[j * genotyping_data.num_samples + i],
+            genotyping_data.get_observed_alleles(j, i), coi,
+            allele_frequencies, epsilon_neg, epsilon_pos, ws);
+    }
+    return calc_genotype_marginal_llik(
+        genotyping_data.get_observed_alleles(j, i), coi, allele_frequencies,
+        epsilon_neg, epsilon_pos, ws);
+}
+
+// a latent genotype with more alleles than the COI cannot be drawn
+double Chain::latent_genotype_llik(
+    std::vector<int> const &latent_genotype, AlleleSet const &obs_genotype,
+    int coi, std::vector<double> const &allele_frequencies, double epsilon_neg,
+    double epsilon_pos, Workspace &ws)
+{
+    if ((int)latent_genotype.size() > coi)
+    {
+        return -std::numeric_limits<double>::infinity();
+    }
+    return calc_genotype_log_pmf(latent_genotype, obs_genotype, epsilon_pos,
+                                 epsilon_neg, coi, allele_frequencies, ws);
+}
+
+/*
+ * Marginal of sample i at locus j under the current allele frequencies and
+ * error rates. Exact marginals are deterministic and are served from the
+ * cache while neither changes; importance sampled ones are re-estimated on
+ * every call.
+ */
+double Chain::cached_genotype_marginal_llik(size_t j, size_t i, int coi,
+                                            Workspace &ws)
+{
+    const bool exact = is_cacheable(coi, p[j].size());
+    if (exact)
+    {
+        const double *cached = marginal_cache_.find(j, i, coi);
+        if (params.profile)
+        {
+            ws.profile.marginal_cache.record(cached != nullptr);
+        }
+        if (cached != nullptr)
+        {
+            return *cached;
+        }
+    }
+
+    double res = genotype_llik(j, i, coi, p[j], eps_neg[i], eps_pos[i], ws);
+    if (exact)
+    {
+        marginal_cache_.store(j, i, coi, res);
+    }
+    return res;
+}
+
+/*
+ * cached_genotype_marginal_llik at each of cois, ascending and distinct,
+ * computing those not in the cache together. Nothing is stored, the cache
+ * only has room for the few COIs a sample is likely to be at.
+ */
+void Chain::cached_genotype_marginal_lliks(size_t j, size_t i,
+                                           std::vector<int> const &cois,
+                                           Workspace &ws,
+                                           std::vector<double> &res)
+{
+    res.resize(cois.size());
+    ws.uncachedCois.clear();
+    for (size_t c = 0; c < cois.size(); c++)
+    {
+        const double *cached = nullptr;
+        if (is_cacheable(cois[c], p[j].size()))
+        {
+            cached = marginal_cache_.find(j, i, cois[c]);
+            if (params.profile)
             {
-                marginal_llik = calc_genotype_marginal_llik(
-                    genotyping_data.get_observed_alleles(j, i), m[i], p[j],
-                    eps_neg[i], eps_pos[i]);
+                ws.profile.marginal_cache.record(cached != nullptr);
             }
-            llik_old[j][i] = marginal_llik;
-            llik_new[j][i] = marginal_llik;
+        }
+        if (cached != nullptr)
+        {
+            res[c] = *cached;
+        }
+        else
+        {
+            ws.uncachedCois.push_back(cois[c]);
         }
     }
-};
+    if (ws.uncachedCois.empty())
+    {
+        return;
+    }
 
-void Chain::calculate_llik()
+    if (augmented())
+    {
+        ws.uncachedLliks.resize(ws.uncachedCois.size());
+        for (size_t c = 0; c < ws.uncachedCois.size(); c++)
+        {
+            ws.uncachedLliks[c] = genotype_llik(j, i, ws.uncachedCois[c], p[j],
+                                                eps_neg[i], eps_pos[i], ws);
+        }
+    }
+    else
+    {
+        calc_genotype_marginal_lliks(genotyping_data.get_observed_alleles(j, i),
+                                     ws.uncachedCois, p[j], eps_neg[i],
+                                     eps_pos[i], ws, ws.uncachedLliks);
+    }
+    size_t computed = 0;
+    for (size_t c = 0; c < cois.size() && computed < ws.uncachedCois.size();
+         c++)
+    {
+        if (cois[c] == ws.uncachedCois[computed])
+        {
+            res[c] = ws.uncachedLliks[computed++];
+        }
+    }
+}
+
+void Chain::cache_marginal_llik(size_t j, size_t i, int coi, double llik)
 {
-    llik = 0;
+    if (is_cacheable(coi, p[j].size()))
+    {
+        marginal_cache_.store(j, i, coi, llik);
+    }
+}
+
+// sample i moved to new error rates, the marginals thread t proposed become
+// current
+void Chain::accept_sample_marginals(size_t i, int t)
+{
+    marginal_cache_.invalidate_sample(i);
+    llik_store_.accept_sample(i, t);
     for (size_t j = 0; j < genotyping_data.num_loci; j++)
     {
-        for (size_t i = 0; i < genotyping_data.num_samples; i++)
+        if (!genotyping_data.is_missing(j, i))
         {
-            llik += llik_old[j][i];
+            cache_marginal_llik(j, i, m[i], llik_store_(j, i));
         }
     }
+}
+
+Workspace &Chain::seeded_workspace(int thread_id, RandomStream family,
+                                   size_t index, int iteration)
+{
+    Workspace &ws = workspaces_[thread_id];
+    ws.sampler.seed(params.seed, Sampler::stream_id(family, chain_id_, index),
+                    iteration);
+    return ws;
+}
+
+void Chain::initialize_likelihood()
+{
+    llik_store_.resize(genotyping_data.num_loci, genotyping_data.num_samples,
+                       pool_->size());
+    marginal_cache_.resize(genotyping_data.num_loci,
+                           genotyping_data.num_samples);
+
+    pool_->parallel_for(genotyping_data.num_samples, [&](size_t i, int t) {
+        Workspace &ws = seeded_workspace(t, RandomStream::Initialize, i, 0);
+        for (size_t j = 0; j < genotyping_data.num_loci; j++)
+        {
+            if (!genotyping_data.is_missing(j, i))
+            {
+                llik_store_(j, i) =
+                    cached_genotype_marginal_llik(j, i, m[i], ws);
+            }
+        }
+    });
+};
+
+void Chain::calculate_llik()
+{
+    llik = llik_store_.total();
 
     for (size_t i = 0; i < genotyping_data.num_samples; i++)
     {
-        llik += sampler.get_epsilon_log_prior(eps_neg[i], params.eps_neg_alpha,
-                                              params.eps_neg_beta);
-        llik += sampler.get_epsilon_log_prior(eps_pos[i], params.eps_pos_alpha,
-                                              params.eps_pos_beta);
+        llik += sampler.get_epsilon_log_prior(
+            eps_neg[i], params.eps_neg_alpha, params.eps_neg_beta,
+            params.eps_neg_log_beta);
+        llik += sampler.get_epsilon_log_prior(
+            eps_pos[i], params.eps_pos_alpha, params.eps_pos_beta,
+            params.eps_pos_log_beta);
         llik += sampler.get_coi_log_prob(m[i], mean_coi);
     }
 
     llik += sampler.get_coi_mean_log_prior(
-        mean_coi, params.mean_coi_prior_shape, params.mean_coi_prior_scale);
+        mean_coi, params.mean_coi_prior_shape, params.mean_coi_prior_scale,
+        params.mean_coi_prior_log_gamma);
 }
 
-double Chain::get_llik()
+double Chain::get_llik() const { return llik; }
+
+void Chain::resync_llik(int iteration)
 {
-    calculate_llik();
-    return llik;
+    if ((iteration + 1) % llik_resync_interval == 0)
+    {
+        calculate_llik();
+    }
 }
 
-Chain::Chain(GenotypingData genotyping_data, Lookup lookup, Parameters params)
+void Chain::reset_llik_deltas(size_t n) { llik_deltas_.assign(n, 0); }
+
+// summed in index order, so llik is the same whatever the thread count
+void Chain::apply_llik_deltas()
+{
+    for (const auto &delta : llik_deltas_)
+    {
+        llik += delta;
+    }
+}
+
+double Chain::adapt_scale(double scale, double log_accept, int iteration,
+                          double lower, double upper) const
+{
+    if (!adapting_)
+    {
+        return scale;
+    }
+    const double accept = std::exp(std::min(log_accept, 0.0));
+    const double step = std::pow(iteration + 1.0, -adaptation_decay);
+    return std::min(
+        upper,
+        std::max(lower, scale * std::exp(step * (accept - target_acceptance))));
+}
+
+double Chain::untempered_delta(double tempered_delta, double data_delta) const
+{
+    return tempered_delta + data_delta * (1 - 1 / temp);
+}
+
+double Chain::get_data_llik() { return llik_store_.total(); }
+
+Profile Chain::get_profile() const
+{
+    Profile res = profile_;
+    for (const auto &ws : workspaces_)
+    {
+        res.merge(ws.profile);
+    }
+    return res;
+}
+
+Chain::Chain(const GenotypingData &genotyping_data, const Lookup &lookup,
+             Parameters params, double temp, int chain_id)
     : genotyping_data(genotyping_data),
       lookup(lookup),
       params(params),
-      sampler(lookup)
+      sampler(lookup),
+      pool_(new ThreadPool(params.num_threads)),
+      chain_id_(chain_id),
+      temp(temp)
 
 {
+    sampler.seed(params.seed,
+                 Sampler::stream_id(RandomStream::Chain, chain_id));
     llik = 0;
-    eps_pos_var = params.eps_pos_var;
-    eps_neg_var = params.eps_neg_var;
-    m_prop_mean = std::vector<double>(genotyping_data.num_samples, 1);
-    p_prop_var = std::vector<double>(genotyping_data.num_loci, 1);
+    workspaces_.reserve(pool_->size());
+    for (int t = 0; t < pool_->size(); t++)
+    {
+        workspaces_.emplace_back(lookup);
+    }
+
+    // proposals start from the scales given, the COI proposals from a mean
+    // step of 3
+    adapting_ = params.adapt_proposals;
+    mean_coi_var = params.mean_coi_var;
+    eps_pos_var.assign(genotyping_data.num_samples, params.eps_pos_var);
+    eps_neg_var.assign(genotyping_data.num_samples, params.eps_neg_var);
+    m_prop_mean.assign(genotyping_data.num_samples, 3);
+    p_prop_var.assign(genotyping_data.num_loci, params.allele_freq_var);
 
     initialize_p();
     initialize_m();
     initialize_eps_neg();
     initialize_eps_pos();
     initialize_mean_coi();
+    initialize_latent_genotypes();
     initialize_likelihood();
+    calculate_llik();
 };
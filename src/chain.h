@@ -3,26 +3,59 @@
 #ifndef CHAIN_H_
 #define CHAIN_H_
 
+#include "allele_set.h"
+#include "checkpoint.h"
 #include "combination_indices_generator.h"
 #include "genotyping_data.h"
+#include "likelihood_store.h"
 #include "lookup.h"
+#include "marginal_cache.h"
 #include "parameters.h"
+#include "profile.h"
 #include "prob_any_missing.h"
 #include "sampler.h"
+#include "thread_pool.h"
+#include "workspace.h"
 
 #include <Rcpp.h>
+#include <memory>
 
 class Chain
 {
+    friend class KernelBenchmark;
+
    private:
-    GenotypingData genotyping_data;
-    Lookup lookup;
+    const GenotypingData &genotyping_data;
+    const Lookup &lookup;
     Parameters params;
     Sampler sampler;
-    probAnyMissingFunctor probAnyMissing_;
-    std::vector<double> prVec_{};
 
-    CombinationIndicesGenerator allele_index_generator_;
+    // one workspace per thread in pool_
+    std::unique_ptr<ThreadPool> pool_;
+    std::vector<Workspace> workspaces_{};
+
+    // selects the chain's family of random number streams
+    int chain_id_;
+
+    // current marginal likelihood of every locus and sample
+    LikelihoodStore llik_store_{};
+    // exact marginals under the current allele frequencies and error rates
+    MarginalCache marginal_cache_{};
+
+    // change in llik from each locus or sample's accepted move in the
+    // current update
+    std::vector<double> llik_deltas_{};
+    void reset_llik_deltas(size_t n);
+    void apply_llik_deltas();
+    // change in the untempered log posterior of a move whose tempered change
+    // is tempered_delta, data_delta of which from the data likelihood
+    double untempered_delta(double tempered_delta, double data_delta) const;
+
+    // workspace of the thread, its sampler restarted on the stream of the
+    // index'th locus or sample for this iteration, so draws do not depend on
+    // how work is split across threads
+    Workspace &seeded_workspace(int thread_id, RandomStream family,
+                                size_t index, int iteration);
 
     void initialize_p();
     void initialize_m();
@@ -30,11 +63,40 @@ class Chain
     void initialize_eps_neg();
     void initialize_eps_pos();
     void initialize_likelihood();
+    void initialize_latent_genotypes();
+
+    // with data augmentation, the latent genotype of every sample at every
+    // locus as ascending allele indices, ordered by locus, then sample
+    std::vector<std::vector<int>> latent_genotypes_{};
+    bool augmented() const
+    {
+        return params.marginal_method == MarginalMethod::DataAugmentation;
+    }
+
+    // likelihood of sample i at locus j, marginal over the latent genotype
+    // or, with data augmentation, joint with the current latent genotype
+    double genotype_llik(size_t j, size_t i, int coi,
+                         std::vector<double> const &allele_frequencies,
+                         double epsilon_neg, double epsilon_pos,
+                         Workspace &ws);
+    double latent_genotype_llik(std::vector<int> const &latent_genotype,
+                                AlleleSet const &obs_genotype, int coi,
+                                std::vector<double> const &allele_frequencies,
+                                double epsilon_neg, double epsilon_pos,
+                                Workspace &ws);
+    // add, remove or swap an allele of latent_genotype into
+    // ws.latentProposal, see update_latent_genotypes
+    double propose_latent_move(std::vector<int> const &latent_genotype,
+                               AlleleSet const &obs_genotype, int coi,
+                               Workspace &ws);
+    // draw the error rates from their conditionals given the latent
+    // genotypes, eps_neg if negative and eps_pos otherwise
+    void update_eps_conjugate(int iteration, bool negative);
 
-    std::vector<double> reweight_allele_frequencies(
+    void reweight_allele_frequencies(
         std::vector<double> const &allele_frequencies,
-        std::vector<int> const &observed_genotype, double epsilon_neg,
-        double epsilon_pos, int coi);
+        AlleleSet const &observed_genotype, double epsilon_neg,
+        double epsilon_pos, int coi, std::vector<double> &res);
 
     // std::vector<double> calc_genotype_log_pmf(
     //     std::vector<std::vector<int>> const &genotypes, int coi,
@@ -42,49 +104,114 @@ class Chain
 
     double calc_transmission_process(
         std::vector<int> const &allele_index_vec,
-        std::vector<double> const &allele_frequencies, int coi);
+        std::vector<double> const &allele_frequencies, int coi, Workspace &ws);
 
     double calc_observation_process(std::vector<int> const &allele_index_vec,
-                                    std::vector<int> const &obs_genotype,
-                                    int coi, double epsilon_neg,
-                                    double epsilon_pos);
+                                    AlleleSet const &obs_genotype, int coi,
+                                    double epsilon_neg, double epsilon_pos);
 
     double calc_genotype_log_pmf(std::vector<int> const &allele_index_vec,
-                                 std::vector<int> const &obs_genotype,
+                                 AlleleSet const &obs_genotype,
                                  double epsilon_pos, double epsilon_neg,
                                  int coi,
-                                 std::vector<double> const &allele_frequencies);
+                                 std::vector<double> const &allele_frequencies,
+                                 Workspace &ws);
 
     std::vector<double> calc_obs_genotype_lliks(
         std::vector<int> const &obs_genotype,
         std::vector<std::vector<int>> const &true_genotypes, double epsilon_neg,
         double epsilon_pos, int num_genotypes);
 
+    // method calc_genotype_marginal_llik uses for coi and num_alleles, never
+    // Auto
+    MarginalMethod resolve_marginal_method(int coi, int num_alleles);
+    // marginals computed at coi are exact and fixed while the allele
+    // frequencies and error rates are
+    bool is_cacheable(int coi, int num_alleles);
+    // count a marginal evaluated by method when profiling
+    void record_marginal(MarginalMethod method, int coi, int num_alleles,
+                         Workspace &ws);
+
+    // update times when profiling, the marginals and lookups being counted
+    // in each thread's workspace
+    Profile profile_{};
+    Profile *profiling() { return params.profile ? &profile_ : nullptr; }
+
+    double cached_genotype_marginal_llik(size_t j, size_t i, int coi,
+                                         Workspace &ws);
+    void cache_marginal_llik(size_t j, size_t i, int coi, double llik);
+    void accept_sample_marginals(size_t i, int t);
+
     long double calc_genotype_marginal_llik(
-        std::vector<int> const &obs_genotype,
-        std::vector<int> const &emphasized_alleles, int coi,
+        AlleleSet const &obs_genotype,
+        AlleleSet const &emphasized_alleles, int coi,
         std::vector<double> const &allele_frequencies, double epsilon_neg,
-        double epsilon_pos);
+        double epsilon_pos, Workspace &ws);
 
     long double calc_genotype_marginal_llik(
-        std::vector<int> const &obs_genotype, int coi,
+        AlleleSet const &obs_genotype, int coi,
         std::vector<double> const &allele_frequencies, double epsilon_neg,
-        double epsilon_pos);
+        double epsilon_pos, Workspace &ws);
 
     long double calc_exact_genotype_marginal_llik(
-        std::vector<int> const &obs_genotype, int coi,
+        AlleleSet const &obs_genotype, int coi,
+        std::vector<double> const &allele_frequencies, double epsilon_neg,
+        double epsilon_pos, Workspace &ws);
+
+    long double calc_dp_genotype_marginal_llik(
+        AlleleSet const &obs_genotype, int coi,
         std::vector<double> const &allele_frequencies, double epsilon_neg,
-        double epsilon_pos);
+        double epsilon_pos, Workspace &ws);
+
+    void calc_dp_coefficients(AlleleSet const &obs_genotype, int max_coi,
+                              std::vector<double> const &allele_frequencies,
+                              double epsilon_neg, double epsilon_pos,
+                              Workspace &ws);
+
+    // marginals at several COIs at once, cois ascending and distinct
+    void calc_exact_genotype_marginal_lliks(
+        AlleleSet const &obs_genotype, std::vector<int> const &cois,
+        std::vector<double> const &allele_frequencies, double epsilon_neg,
+        double epsilon_pos, Workspace &ws, std::vector<double> &res);
+
+    void calc_genotype_marginal_lliks(
+        AlleleSet const &obs_genotype, std::vector<int> const &cois,
+        std::vector<double> const &allele_frequencies, double epsilon_neg,
+        double epsilon_pos, Workspace &ws, std::vector<double> &res);
+
+    void cached_genotype_marginal_lliks(size_t j, size_t i,
+                                        std::vector<int> const &cois,
+                                        Workspace &ws,
+                                        std::vector<double> &res);
+
+    void update_m_multiple_try(int iteration);
+    void score_coi_tries(size_t i, size_t first, size_t last, Workspace &ws);
 
     long double calc_estimated_genotype_marginal_llik(
-        std::vector<int> const &obs_genotype,
-        std::vector<int> const &emphasized_alleles, int coi,
+        AlleleSet const &obs_genotype,
+        AlleleSet const &emphasized_alleles, int coi,
+        std::vector<double> const &allele_frequencies, double epsilon_neg,
+        double epsilon_pos, int sampling_depth, Workspace &ws);
+
+    long double calc_variance_reduced_genotype_marginal_llik(
+        AlleleSet const &obs_genotype,
+        AlleleSet const &emphasized_alleles, int coi,
         std::vector<double> const &allele_frequencies, double epsilon_neg,
-        double epsilon_pos, int sampling_depth);
+        double epsilon_pos, int sampling_depth, Workspace &ws);
+
+    // proposals are tuned until end_adaptation
+    bool adapting_;
+    // Robbins-Monro step of a proposal scale after a move accepted with
+    // probability exp(log_accept), moving its log towards the target
+    // acceptance rate with steps shrinking with the iteration, clamped to
+    // [lower, upper]. The scale is returned as is once adaptation ends
+    double adapt_scale(double scale, double log_accept, int iteration,
+                       double lower, double upper) const;
+
+    void record_importance_sampling_error(double sum, double sum_sq, int n,
+                                          double estimate, Workspace &ws);
 
    public:
-    std::vector<std::vector<double>> llik_old{};
-    std::vector<std::vector<double>> llik_new{};
     double llik;
 
     // Mean COI
@@ -92,16 +219,20 @@ class Chain
     // std::string prior;
     // double poisson_prior_lambda;
     double mean_coi;
+    // standard deviation of mean COI proposals
+    double mean_coi_var;
 
     // COI
     std::vector<int> m{};
     int prop_m;
     std::vector<int> m_accept{};
+    // mean size of each sample's COI proposals
     std::vector<double> m_prop_mean{};
 
     // Allele Frequencies
     std::vector<std::vector<double>> p{};
     std::vector<double> prop_p{};
+    // standard deviation of each locus' logit scale proposals
     std::vector<double> p_prop_var{};
     std::vector<int> p_accept{};
 
@@ -110,18 +241,23 @@ class Chain
     std::vector<double> eps_pos{};
     double prop_eps_pos;
     std::vector<int> eps_pos_accept{};
-    double eps_pos_var;
+    // standard deviation of each sample's proposals
+    std::vector<double> eps_pos_var{};
 
     // Epsilon Negative
     // double eps_neg;
     std::vector<double> eps_neg{};
     double prop_eps_neg;
     std::vector<int> eps_neg_accept{};
-    double eps_neg_var;
+    std::vector<double> eps_neg_var{};
 
     std::vector<int> individual_accept{};
 
-    Chain(GenotypingData genotyping_data, Lookup lookup, Parameters params);
+    // temperature of the chain, the data likelihood is raised to 1 / temp
+    double temp;
+
+    Chain(const GenotypingData &genotyping_data, const Lookup &lookup,
+          Parameters params, double temp = 1, int chain_id = 0);
     void update_m(int iteration);
     void update_mean_coi(int iteration);
     void update_p(int iteration);
@@ -129,8 +265,30 @@ class Chain
     void update_eps_pos(int iteration);
     void update_eps_neg(int iteration);
     void update_individual_parameters(int iteration);
+    // with data augmentation, move each latent genotype by a few single
+    // allele changes
+    void update_latent_genotypes(int iteration);
+    // fix the proposal scales, e.g. once burnin is over
+    void end_adaptation() { adapting_ = false; };
+    // recompute llik from scratch
     void calculate_llik();
-    double get_llik();
+    // log posterior, kept up to date by each update's accepted moves
+    double get_llik() const;
+    // llik accumulates rounding error, recompute it every
+    // llik_resync_interval iterations
+    static constexpr int llik_resync_interval = 100;
+    void resync_llik(int iteration);
+    // log likelihood of the data alone, untempered
+    double get_data_llik();
+    // mean relative standard error of the importance sampled marginals, NaN
+    // if none were sampled
+    double get_importance_sampling_error() const;
+    // counts of the run when profiling, summed over the threads
+    Profile get_profile() const;
+    // save or restore everything later updates depend on, the random number
+    // streams being determined by the seed, chain id and iteration
+    void write_state(CheckpointWriter &out) const;
+    void read_state(CheckpointReader &in);
 };
 
 #endif  // CHAIN_H_
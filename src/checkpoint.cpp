@@ -0,0 +1,76 @@
+#include "checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+
+CheckpointWriter::CheckpointWriter(const std::string &path,
+                                   const std::vector<char> &args)
+    : path_(path),
+      tmp_path_(path + ".tmp"),
+      out_(tmp_path_, std::ios::binary | std::ios::trunc)
+{
+    if (!out_)
+    {
+        throw std::runtime_error("Unable to open checkpoint file " +
+                                 tmp_path_);
+    }
+
+    const int32_t header[2] = {Checkpoint::version, 0};
+    write_bytes("MOIRECKP", 8);
+    write_bytes(header, sizeof(header));
+    write((double)args.size());
+    write_bytes(args.data(), args.size());
+}
+
+void CheckpointWriter::write_bytes(const void *data, size_t bytes)
+{
+    out_.write(static_cast<const char *>(data), bytes);
+    if (!out_)
+    {
+        throw std::runtime_error("Unable to write checkpoint file " +
+                                 tmp_path_);
+    }
+}
+
+void CheckpointWriter::commit()
+{
+    out_.close();
+    if (!out_ || std::rename(tmp_path_.c_str(), path_.c_str()) != 0)
+    {
+        throw std::runtime_error("Unable to write checkpoint file " + path_);
+    }
+}
+
+CheckpointReader::CheckpointReader(const std::string &path)
+    : path_(path), in_(path, std::ios::binary)
+{
+    if (!in_)
+    {
+        throw std::runtime_error("Unable to open checkpoint file " + path);
+    }
+
+    char magic[8];
+    read_bytes(magic, sizeof(magic));
+    if (std::memcmp(magic, "MOIRECKP", sizeof(magic)) != 0)
+    {
+        throw std::runtime_error("Not a moire checkpoint file: " + path);
+    }
+    if (read<int32_t>() != Checkpoint::version)
+    {
+        throw std::runtime_error("Unsupported checkpoint version: " + path);
+    }
+    read<int32_t>();
+
+    // the R arguments are only read by resume_mcmc()
+    const double args_bytes = read<double>();
+    in_.seekg((std::streamoff)args_bytes, std::ios::cur);
+}
+
+void CheckpointReader::read_bytes(void *data, size_t bytes)
+{
+    in_.read(static_cast<char *>(data), bytes);
+    if (!in_)
+    {
+        throw std::runtime_error("Checkpoint file " + path_ + " is truncated");
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * Binary checkpoint of a run, written by MCMC::write_checkpoint. Values are
+ * native endian, so a checkpoint is resumed on the kind of machine that
+ * wrote it.
+ *
+ * Header:
+ *   char[8] "MOIRECKP", int32 version, int32 0, double args_bytes,
+ *   args_bytes of serialized R arguments of the run (see resume_mcmc())
+ *
+ * followed by the state of the run. Vectors are written with their length
+ * so reading a checkpoint against other data fails rather than misreads.
+ */
+namespace Checkpoint
+{
+constexpr int32_t version = 1;
+}
+
+// writes to a temporary file, moved over path by commit() so a run stopped
+// mid write leaves the previous checkpoint intact
+class CheckpointWriter
+{
+   public:
+    // writes the header holding args
+    CheckpointWriter(const std::string &path, const std::vector<char> &args);
+
+    template <typename T>
+    void write(const T &value)
+    {
+        write_bytes(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void write(const std::vector<T> &values)
+    {
+        write((int64_t)values.size());
+        write_bytes(values.data(), values.size() * sizeof(T));
+    }
+
+    void write_bytes(const void *data, size_t bytes);
+    void commit();
+
+   private:
+    std::string path_;
+    std::string tmp_path_;
+    std::ofstream out_;
+};
+
+class CheckpointReader
+{
+   public:
+    // reads the header, skipping the arguments
+    CheckpointReader(const std::string &path);
+
+    template <typename T>
+    T read()
+    {
+        T value;
+        read_bytes(&value, sizeof(T));
+        return value;
+    }
+
+    // values must already have the length written
+    template <typename T>
+    void read(std::vector<T> &values)
+    {
+        if (read<int64_t>() != (int64_t)values.size())
+        {
+            throw std::runtime_error("Checkpoint " + path_ +
+                                     " does not match the data of the run");
+        }
+        read_bytes(values.data(), values.size() * sizeof(T));
+    }
+
+    void read_bytes(void *data, size_t bytes);
+
+   private:
+    std::string path_;
+    std::ifstream in_;
+};
+
+#endif  // CHECKPOINT_H_
@@ -0,0 +1,187 @@
+#include "convergence_monitor.h"
+
+#include <cmath>
+#include <limits>
+
+namespace
+{
+struct Moments
+{
+    double mean;
+    double variance;
+};
+
+// mean and sample variance of values [first, last)
+Moments moments(const double *first, const double *last)
+{
+    const double n = last - first;
+    double sum = 0;
+    for (const double *x = first; x != last; ++x)
+    {
+        sum += *x;
+    }
+    const double mean = sum / n;
+
+    double sum_sq = 0;
+    for (const double *x = first; x != last; ++x)
+    {
+        sum_sq += (*x - mean) * (*x - mean);
+    }
+    return {mean, sum_sq / (n - 1)};
+}
+}  // namespace
+
+ConvergenceMonitor::ConvergenceMonitor(size_t num_chains, size_t num_loci)
+    : values_(num_chains, std::vector<std::vector<double>>(num_loci + 2))
+{
+}
+
+void ConvergenceMonitor::record(size_t k, const Chain &chain)
+{
+    auto &values = values_[k];
+    values[0].push_back(chain.get_llik());
+    values[1].push_back(chain.mean_coi);
+    for (size_t j = 0; j < chain.p.size(); j++)
+    {
+        double sum_sq = 0;
+        for (const double freq : chain.p[j])
+        {
+            sum_sq += freq * freq;
+        }
+        values[j + 2].push_back(1 - sum_sq);
+    }
+}
+
+void ConvergenceMonitor::clear()
+{
+    for (auto &chain_values : values_)
+    {
+        for (auto &values : chain_values)
+        {
+            values.clear();
+        }
+    }
+}
+
+/*
+ * Gelman et al. (2013), Bayesian Data Analysis section 11.4: each chain's
+ * values are split in two halves and the between and within half variances
+ * compared, so drifts within a single chain are detected too.
+ */
+std::vector<double> ConvergenceMonitor::split_rhat(size_t first) const
+{
+    const size_t num_quantities = values_[0].size();
+    const size_t n = (length() - first) / 2;
+    std::vector<double> rhat(num_quantities,
+                             std::numeric_limits<double>::quiet_NaN());
+    if (n < 2)
+    {
+        return rhat;
+    }
+
+    const double num_halves = 2 * values_.size();
+    for (size_t q = 0; q < num_quantities; q++)
+    {
+        double within = 0;
+        double sum_means = 0;
+        double sum_sq_means = 0;
+        for (const auto &chain_values : values_)
+        {
+            // the latest 2n values, dropping one if there is an odd number
+            const double *last = chain_values[q].data() + length();
+            for (const double *half : {last - 2 * n, last - n})
+            {
+                const Moments m = moments(half, half + n);
+                within += m.variance;
+                sum_means += m.mean;
+                sum_sq_means += m.mean * m.mean;
+            }
+        }
+        within /= num_halves;
+        const double mean = sum_means / num_halves;
+        // between half variance of the means, B / n in BDA's notation
+        const double between =
+            (sum_sq_means - num_halves * mean * mean) / (num_halves - 1);
+
+        if (within == 0)
+        {
+            // constant within every half
+            rhat[q] = between == 0 ? 1
+                                   : std::numeric_limits<double>::infinity();
+            continue;
+        }
+        const double pooled = (n - 1) / (double)n * within + between;
+        rhat[q] = std::sqrt(pooled / within);
+    }
+    return rhat;
+}
+
+/*
+ * Batch means: the n values are cut into floor(sqrt(n)) batches of
+ * b = floor(n / batches) values, and the variance of the batch means
+ * compared to that of single values, ESS = n * var / (b * var_batch).
+ */
+std::vector<double> ConvergenceMonitor::ess() const
+{
+    const size_t num_quantities = values_[0].size();
+    const size_t n = length();
+    const size_t num_batches = (size_t)std::sqrt((double)n);
+    std::vector<double> res(num_quantities, 0);
+    if (num_batches < 2)
+    {
+        res.assign(num_quantities, std::numeric_limits<double>::quiet_NaN());
+        return res;
+    }
+    const size_t batch_size = n / num_batches;
+
+    std::vector<double> batch_means(num_batches);
+    for (const auto &chain_values : values_)
+    {
+        for (size_t q = 0; q < num_quantities; q++)
+        {
+            const double *values = chain_values[q].data();
+            for (size_t b = 0; b < num_batches; b++)
+            {
+                batch_means[b] =
+                    moments(values + b * batch_size,
+                            values + (b + 1) * batch_size)
+                        .mean;
+            }
+            const double variance = moments(values, values + n).variance;
+            const double batch_variance =
+                moments(batch_means.data(), batch_means.data() + num_batches)
+                    .variance;
+
+            // a constant quantity, or batches with identical means
+            res[q] += batch_variance == 0
+                          ? n
+                          : n * variance / (batch_size * batch_variance);
+        }
+    }
+    return res;
+}
+
+void ConvergenceMonitor::write_state(CheckpointWriter &out) const
+{
+    out.write((int64_t)length());
+    for (const auto &chain_values : values_)
+    {
+        for (const auto &values : chain_values)
+        {
+            out.write(values);
+        }
+    }
+}
+
+void ConvergenceMonitor::read_state(CheckpointReader &in)
+{
+    const size_t n = in.read<int64_t>();
+    for (auto &chain_values : values_)
+    {
+        for (auto &values : chain_values)
+        {
+            values.resize(n);
+            in.read(values);
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#ifndef CONVERGENCE_MONITOR_H_
+#define CONVERGENCE_MONITOR_H_
+
+#include "chain.h"
+#include "checkpoint.h"
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Keeps the history of the log posterior, the mean COI and each locus'
+ * expected heterozygosity in each untempered chain, from which MCMC decides
+ * when burnin has converged, by split R-hat, and when enough draws have been
+ * made, by effective sample size.
+ */
+class ConvergenceMonitor
+{
+   public:
+    ConvergenceMonitor(size_t num_chains, size_t num_loci);
+
+    // append the current values of the quantities of the k'th chain
+    void record(size_t k, const Chain &chain);
+    // drop the history, e.g. once burnin is over
+    void clear();
+    // values recorded per chain
+    size_t length() const { return values_[0][0].size(); };
+
+    // split R-hat of each quantity over the values from first on, NaN with
+    // fewer than four values
+    std::vector<double> split_rhat(size_t first = 0) const;
+    // batch means effective sample size of each quantity, summed over the
+    // chains
+    std::vector<double> ess() const;
+
+    void write_state(CheckpointWriter &out) const;
+    void read_state(CheckpointReader &in);
+
+   private:
+    // values_[k][q] values of quantity q, llik, mean_coi then the
+    // heterozygosity of each locus, in chain k
+    std::vector<std::vector<std::vector<double>>> values_{};
+};
+
+#endif  // CONVERGENCE_MONITOR_H_
@@ -1,58 +1,179 @@
-
 #include "genotyping_data.h"
 
 #include "mcmc_utils.h"
 
-std::vector<std::vector<std::vector<int>>> GenotypingData::observed_alleles;
-std::vector<std::vector<bool>> GenotypingData::is_missing_;
-std::vector<int> GenotypingData::observed_coi;
-std::vector<int> GenotypingData::num_alleles;
-size_t GenotypingData::num_samples;
-size_t GenotypingData::num_loci;
-int GenotypingData::max_alleles;
+#include <map>
 
 GenotypingData::GenotypingData(const Rcpp::List &args)
 {
-    observed_alleles = UtilFunctions::r_to_array_int(args["data"]);
-    is_missing_ = UtilFunctions::r_to_mat_bool(args["is_missing"]);
+    Rcpp::List data(args["data"]);
+
+    num_loci = data.size();
+    num_samples = Rcpp::List(data[0]).size();
+    sparse_observations =
+        UtilFunctions::r_to_bool(args["sparse_observations"]);
+
+    // convert one locus at a time so the unpacked data is never resident
+    std::vector<std::vector<int>> genotypes(num_samples);
+    for (size_t i = 0; i < num_loci; i++)
+    {
+        Rcpp::List locus(data[i]);
+        for (size_t j = 0; j < num_samples; j++)
+        {
+            Rcpp::NumericVector genotype(locus[j]);
+            genotypes[j] = Rcpp::as<std::vector<int>>(genotype);
+        }
+        append_locus(genotypes);
+    }
+
+    set_missing(UtilFunctions::r_to_mat_bool(args["is_missing"]));
+    index_genotypes();
+}
 
+GenotypingData::GenotypingData(
+    const std::vector<std::vector<std::vector<int>>> &observed_alleles,
+    const std::vector<std::vector<bool>> &is_missing, bool sparse)
+{
     num_loci = observed_alleles.size();
     num_samples = observed_alleles[0].size();
+    sparse_observations = sparse;
 
-    num_alleles = std::vector<int>(num_loci);
-    observed_coi = std::vector<int>(num_samples, 0);
+    for (const auto &genotypes : observed_alleles)
+    {
+        append_locus(genotypes);
+    }
 
-    for (size_t i = 0; i < num_loci; i++)
+    set_missing(is_missing);
+    index_genotypes();
+}
+
+void GenotypingData::append_locus(
+    const std::vector<std::vector<int>> &genotypes)
+{
+    const int locus_alleles = genotypes[0].size();
+    const int locus_words = AlleleSet::num_words(locus_alleles);
+
+    num_alleles.push_back(locus_alleles);
+    if (sparse_observations)
     {
-        num_alleles[i] = observed_alleles[i][0].size();
-        if (num_alleles[i] > max_alleles)
+        if (locus_alleles > AlleleSet::max_sparse_alleles)
         {
-            max_alleles = num_alleles[i];
+            Rcpp::stop("sparse_observations supports at most %d alleles",
+                       AlleleSet::max_sparse_alleles);
+        }
+
+        if (observed_offsets_.empty())
+        {
+            observed_offsets_.push_back(0);
+        }
+        for (const auto &genotype : genotypes)
+        {
+            for (int k = 0; k < locus_alleles; k++)
+            {
+                if (genotype[k] != 0)
+                {
+                    observed_indices_.push_back(k);
+                }
+            }
+            observed_offsets_.push_back(observed_indices_.size());
+        }
+        return;
+    }
+
+    allele_words_.push_back(locus_words);
+    locus_offsets_.push_back(observed_alleles_.size());
+    observed_alleles_.resize(observed_alleles_.size() +
+                                 num_samples * locus_words,
+                             0);
+
+    AlleleSet::word_t *words = observed_alleles_.data() + locus_offsets_.back();
+    for (const auto &genotype : genotypes)
+    {
+        for (int k = 0; k < locus_alleles; k++)
+        {
+            if (genotype[k] != 0)
+            {
+                AlleleSet::set(words, k);
+            }
         }
+        words += locus_words;
+    }
+}
 
+void GenotypingData::set_missing(
+    const std::vector<std::vector<bool>> &is_missing)
+{
+    is_missing_.assign(AlleleSet::num_words(num_loci * num_samples), 0);
+    for (size_t i = 0; i < num_loci; i++)
+    {
         for (size_t j = 0; j < num_samples; j++)
         {
-            int total_alleles = 0;
-            for (size_t k = 0; k < observed_alleles[i][j].size(); k++)
+            if (is_missing[i][j])
             {
-                total_alleles += observed_alleles[i][j][k];
+                AlleleSet::set(is_missing_.data(), i * num_samples + j);
             }
+        }
+    }
+}
+
+void GenotypingData::index_genotypes()
+{
+    observed_coi = std::vector<int>(num_samples, 0);
+    genotype_pattern_ = std::vector<int>(num_loci * num_samples);
+    num_genotype_patterns = std::vector<int>(num_loci);
+    max_alleles = 0;
 
+    for (size_t i = 0; i < num_loci; i++)
+    {
+        std::map<std::vector<int>, int> patterns{};
+        std::vector<int> present{};
+        for (size_t j = 0; j < num_samples; j++)
+        {
+            const AlleleSet genotype = get_observed_alleles(i, j);
+            present.clear();
+            genotype.for_each([&](int allele) { present.push_back(allele); });
+            auto pattern = patterns.emplace(present, (int)patterns.size());
+            genotype_pattern_[i * num_samples + j] = pattern.first->second;
+
+            const int total_alleles = present.size();
             if (total_alleles > observed_coi[j])
             {
                 observed_coi[j] = total_alleles;
             }
         }
+        num_genotype_patterns[i] = patterns.size();
+
+        if (num_alleles[i] > max_alleles)
+        {
+            max_alleles = num_alleles[i];
+        }
     }
 }
 
-const std::vector<int> &GenotypingData::get_observed_alleles(int locus,
-                                                             int sample) const
+AlleleSet GenotypingData::get_observed_alleles(int locus, int sample) const
 {
-    return observed_alleles.at(locus).at(sample);
+    if (sparse_observations)
+    {
+        const size_t cell = locus * num_samples + sample;
+        return AlleleSet(observed_indices_.data() + observed_offsets_[cell],
+                         observed_offsets_[cell + 1] - observed_offsets_[cell],
+                         num_alleles[locus]);
+    }
+
+    return AlleleSet(observed_alleles_.data() + locus_offsets_[locus] +
+                         sample * allele_words_[locus],
+                     num_alleles[locus]);
 }
 
 bool GenotypingData::is_missing(int locus, int sample) const
 {
-    return is_missing_.at(locus).at(sample);
+    const size_t bit = locus * num_samples + sample;
+    return (is_missing_[bit / AlleleSet::bits_per_word] >>
+            (bit % AlleleSet::bits_per_word)) &
+           1;
+}
+
+int GenotypingData::get_genotype_pattern(int locus, int sample) const
+{
+    return genotype_pattern_[locus * num_samples + sample];
 }
@@ -3,6 +3,8 @@
 #ifndef DATA_H_
 #define DATA_H_
 
+#include "allele_set.h"
+
 #include <Rcpp.h>
 
 //------------------------------------------------
@@ -10,21 +12,55 @@
 class GenotypingData
 {
    public:
-    // Data are ordered by Locus, then Sample
-    static std::vector<std::vector<std::vector<int>>> observed_alleles;
-    static std::vector<std::vector<bool>> is_missing_;
-    static std::vector<int> num_alleles;
-    static std::vector<int> observed_coi;
-    static size_t num_samples;
-    static size_t num_loci;
-    static int max_alleles;
+    std::vector<int> num_genotype_patterns{};
+    std::vector<int> num_alleles{};
+    std::vector<int> observed_coi{};
+    size_t num_samples = 0;
+    size_t num_loci = 0;
+    int max_alleles = 0;
+    // genotypes are stored as the indices of the observed alleles rather
+    // than one bit per allele
+    bool sparse_observations = false;
 
     // constructors
-    GenotypingData(){};
     GenotypingData(const Rcpp::List &args);
 
-    const std::vector<int> &get_observed_alleles(int locus, int sample) const;
+    /**
+     * @param observed_alleles 0/1 allele indicators ordered by locus, then
+     * sample
+     * @param is_missing missingness ordered by locus, then sample
+     * @param sparse store only the indices of the observed alleles
+     */
+    GenotypingData(
+        const std::vector<std::vector<std::vector<int>>> &observed_alleles,
+        const std::vector<std::vector<bool>> &is_missing, bool sparse = false);
+
+    AlleleSet get_observed_alleles(int locus, int sample) const;
     bool is_missing(int locus, int sample) const;
+    // index of the sample's observed genotype among the distinct observed
+    // genotypes at the locus
+    int get_genotype_pattern(int locus, int sample) const;
+
+   private:
+    // Data are ordered by Locus, then Sample. The genotypes at locus i start
+    // at word locus_offsets_[i], each sample taking allele_words_[i] words
+    std::vector<AlleleSet::word_t> observed_alleles_{};
+    std::vector<size_t> locus_offsets_{};
+    std::vector<int> allele_words_{};
+
+    // sparse storage, the observed alleles of sample j at locus i are
+    // observed_indices_[observed_offsets_[i * num_samples + j]] up to the
+    // next offset
+    std::vector<AlleleSet::index_t> observed_indices_{};
+    std::vector<size_t> observed_offsets_{};
+
+    // bit locus * num_samples + sample is set if the sample is missing
+    std::vector<AlleleSet::word_t> is_missing_{};
+    std::vector<int> genotype_pattern_{};
+
+    void append_locus(const std::vector<std::vector<int>> &genotypes);
+    void set_missing(const std::vector<std::vector<bool>> &is_missing);
+    void index_genotypes();
 };
 
 #endif  // DATA_H_
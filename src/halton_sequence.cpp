@@ -0,0 +1,52 @@
+#include "halton_sequence.h"
+
+#include <algorithm>
+
+namespace
+{
+constexpr unsigned long primes[HaltonSequence::max_dims] = {
+    2,  3,  5,  7,  11, 13, 17, 19, 23, 29, 31,  37,  41,  43,  47,  53,
+    59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131};
+}
+
+void HaltonSequence::reset(int dims, Sampler &sampler)
+{
+    // the first point of every base is 0, start past it
+    index_ = 1;
+    point_.resize(dims);
+    shifts_.resize(std::min(dims, max_dims));
+    for (auto &shift : shifts_)
+    {
+        shift = sampler.runif_0_1();
+    }
+}
+
+const std::vector<double> &HaltonSequence::next(Sampler &sampler)
+{
+    for (size_t d = 0; d < shifts_.size(); d++)
+    {
+        double u = radical_inverse(index_, primes[d]) + shifts_[d];
+        point_[d] = u < 1 ? u : u - 1;
+    }
+    for (size_t d = shifts_.size(); d < point_.size(); d++)
+    {
+        point_[d] = sampler.runif_0_1();
+    }
+    index_++;
+    return point_;
+}
+
+double HaltonSequence::radical_inverse(unsigned long index,
+                                       unsigned long base)
+{
+    const double inv_base = 1.0 / base;
+    double scale = inv_base;
+    double res = 0;
+    while (index > 0)
+    {
+        res += (index % base) * scale;
+        index /= base;
+        scale *= inv_base;
+    }
+    return res;
+}
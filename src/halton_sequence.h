@@ -0,0 +1,39 @@
+#pragma once
+
+#ifndef HALTON_SEQUENCE_H_
+#define HALTON_SEQUENCE_H_
+
+#include "sampler.h"
+
+#include <vector>
+
+/*
+ * Randomized Halton sequence for quasi Monte Carlo integration. Every point
+ * is shifted modulo 1 by one uniform per dimension (a Cranley-Patterson
+ * rotation), so each point is uniform on the unit cube while the sequence
+ * covers it far more evenly than independent draws. Dimensions beyond the
+ * tabulated primes fall back to independent uniforms from the sampler.
+ */
+class HaltonSequence
+{
+   public:
+    static constexpr int max_dims = 32;
+
+    /**
+     * Start a new sequence of points in dims dimensions, drawing the
+     * rotation from sampler.
+     */
+    void reset(int dims, Sampler &sampler);
+
+    // next point of the sequence, valid until the following call
+    const std::vector<double> &next(Sampler &sampler);
+
+   private:
+    unsigned long index_ = 0;
+    std::vector<double> shifts_{};
+    std::vector<double> point_{};
+
+    static double radical_inverse(unsigned long index, unsigned long base);
+};
+
+#endif  // HALTON_SEQUENCE_H_
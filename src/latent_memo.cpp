@@ -0,0 +1,72 @@
+#include "latent_memo.h"
+
+#include <algorithm>
+
+void LatentMemo::reset(int num_words, size_t max_entries)
+{
+    // keep the load factor at or below one half
+    size_t capacity = 16;
+    while (capacity < 2 * max_entries)
+    {
+        capacity *= 2;
+    }
+
+    if (capacity > generations_.size() || num_words != num_words_)
+    {
+        capacity = std::max(capacity, generations_.size());
+        keys_.resize(capacity * num_words);
+        values_.resize(capacity);
+        generations_.assign(capacity, 0);
+        generation_ = 0;
+    }
+
+    num_words_ = num_words;
+    mask_ = generations_.size() - 1;
+
+    if (++generation_ == 0)
+    {
+        std::fill(generations_.begin(), generations_.end(), 0);
+        generation_ = 1;
+    }
+}
+
+const double *LatentMemo::find(const word_t *key) const
+{
+    const size_t slot = probe(key);
+    if (generations_[slot] != generation_)
+    {
+        return nullptr;
+    }
+    return &values_[slot];
+}
+
+void LatentMemo::insert(const word_t *key, double value)
+{
+    const size_t slot = probe(key);
+    std::copy(key, key + num_words_, keys_.begin() + slot * num_words_);
+    values_[slot] = value;
+    generations_[slot] = generation_;
+}
+
+size_t LatentMemo::hash(const word_t *key) const
+{
+    uint64_t h = 0;
+    for (int w = 0; w < num_words_; w++)
+    {
+        h = (h ^ key[w]) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+size_t LatentMemo::probe(const word_t *key) const
+{
+    size_t slot = hash(key) & mask_;
+    while (generations_[slot] == generation_ &&
+           !std::equal(key, key + num_words_,
+                       keys_.begin() + slot * num_words_))
+    {
+        slot = (slot + 1) & mask_;
+    }
+    return slot;
+}
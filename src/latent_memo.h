@@ -0,0 +1,48 @@
+#pragma once
+
+#ifndef LATENT_MEMO_H_
+#define LATENT_MEMO_H_
+
+#include "allele_set.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Open addressing hash map from a latent genotype, packed one bit per allele
+ * as in AlleleSet, to its importance weight. Slots are stamped with the
+ * generation they were written in, so reset() is O(1) and the storage is
+ * reused across calls without allocating once it has grown to the largest
+ * sampling depth.
+ */
+class LatentMemo
+{
+   public:
+    using word_t = AlleleSet::word_t;
+
+    /**
+     * Empty the memo, making room for max_entries keys of num_words words.
+     */
+    void reset(int num_words, size_t max_entries);
+
+    // value stored for key, nullptr if absent
+    const double *find(const word_t *key) const;
+
+    // key must not already be present
+    void insert(const word_t *key, double value);
+
+   private:
+    int num_words_ = 0;
+    size_t mask_ = 0;
+    uint32_t generation_ = 0;
+
+    std::vector<word_t> keys_{};
+    std::vector<double> values_{};
+    std::vector<uint32_t> generations_{};
+
+    size_t hash(const word_t *key) const;
+    // slot holding key, or the empty slot it would be inserted in
+    size_t probe(const word_t *key) const;
+};
+
+#endif  // LATENT_MEMO_H_
@@ -0,0 +1,33 @@
+#include "likelihood_store.h"
+
+void LikelihoodStore::resize(size_t num_loci, size_t num_samples,
+                             int num_threads)
+{
+    num_loci_ = num_loci;
+    storage_.assign((num_samples + num_threads) * num_loci, 0);
+
+    samples_.resize(num_samples);
+    for (size_t i = 0; i < num_samples; i++)
+    {
+        samples_[i] = storage_.data() + i * num_loci;
+    }
+
+    spares_.resize(num_threads);
+    for (int t = 0; t < num_threads; t++)
+    {
+        spares_[t] = storage_.data() + (num_samples + t) * num_loci;
+    }
+}
+
+double LikelihoodStore::total() const
+{
+    double res = 0;
+    for (const double *block : samples_)
+    {
+        for (size_t j = 0; j < num_loci_; j++)
+        {
+            res += block[j];
+        }
+    }
+    return res;
+}
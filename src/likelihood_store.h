@@ -0,0 +1,58 @@
+#pragma once
+
+#ifndef LIKELIHOOD_STORE_H_
+#define LIKELIHOOD_STORE_H_
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/*
+ * Marginal likelihood of every (locus, sample) pair, stored sample-major so
+ * the per-sample updates read and write one contiguous block. Each thread of
+ * the sample updates owns a spare block to hold its proposed marginals, so
+ * accepting a move swaps the block pointers rather than copying the values.
+ * The allele frequency updates instead read and write a locus across the
+ * blocks, but run once per locus against the several per-sample updates of
+ * each iteration. Missing pairs hold 0.
+ */
+class LikelihoodStore
+{
+   public:
+    LikelihoodStore() = default;
+    // blocks point into storage_
+    LikelihoodStore(const LikelihoodStore &) = delete;
+    LikelihoodStore &operator=(const LikelihoodStore &) = delete;
+
+    // zero marginals with one spare block for each of num_threads threads
+    void resize(size_t num_loci, size_t num_samples, int num_threads);
+
+    double operator()(size_t locus, size_t sample) const
+    {
+        return samples_[sample][locus];
+    }
+    double &operator()(size_t locus, size_t sample)
+    {
+        return samples_[sample][locus];
+    }
+
+    // num_loci marginals for thread t to fill with a sample's proposal
+    double *spare(int t) { return spares_[t]; }
+
+    // the proposal in thread t's spare becomes sample's current block
+    void accept_sample(size_t sample, int t)
+    {
+        std::swap(samples_[sample], spares_[t]);
+    }
+
+    // sum over every pair
+    double total() const;
+
+   private:
+    size_t num_loci_ = 0;
+    std::vector<double> storage_{};
+    std::vector<double *> samples_{};
+    std::vector<double *> spares_{};
+};
+
+#endif  // LIKELIHOOD_STORE_H_
@@ -1,48 +1,105 @@
 #include "lookup.h"
 
-#include "mcmc_utils.h"
-
-#include <cmath>
 #include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <utility>
 
-Lookup::Lookup(int max_alleles) : max_alleles(max_alleles)
+Lookup::Lookup(int max_alleles)
+    : max_alleles_(max_alleles), max_table_coi_(std::min(max_alleles, max_coi))
 {
-    init_lgamma();
+    init_log_factorial();
     init_sampling_depth();
 };
 
-void Lookup::init_lgamma()
+void Lookup::init_log_factorial()
 {
-    lookup_lgamma = std::vector<double>(max_alleles + 2);
-
-    for (size_t i = 0; i < lookup_lgamma.size(); i++)
+    log_factorial_.resize(std::max(max_alleles_, max_coi) + 1);
+    for (size_t n = 0; n < log_factorial_.size(); n++)
     {
-        lookup_lgamma[i] = std::lgamma(i);
+        log_factorial_[n] = std::lgamma(n + 1);
     }
-    lgamma_initialized = true;
 };
 
+namespace
+{
+// log(exp(a) + exp(b))
+double log_add(double a, double b)
+{
+    if (a < b)
+    {
+        std::swap(a, b);
+    }
+    if (b == -std::numeric_limits<double>::infinity())
+    {
+        return a;
+    }
+    return a + std::log1p(std::exp(b - a));
+}
+}  // namespace
+
+// enumeration cost of the latent genotypes of k of n alleles
+double Lookup::log_genotypes_cost(int n, int k) const
+{
+    return log_binomial(n, k) +
+           std::log(enumeration_genotype_cost + std::ldexp(1.0, k));
+}
+
 void Lookup::init_sampling_depth()
 {
-    for (int ii = 1; ii <= max_alleles; ii++)
+    const int stride = max_table_coi_ + 1;
+    sampling_depth_.assign((max_alleles_ + 1) * stride, 0);
+    enumeration_cost_.assign((max_alleles_ + 1) * stride,
+                             -std::numeric_limits<double>::infinity());
+    for (int n = 1; n <= max_alleles_; n++)
     {
-        for (int jj = 1; jj <= ii; jj++)
+        double *row = &sampling_depth_[n * stride];
+        double *cost = &enumeration_cost_[n * stride];
+        for (int k = 1; k <= max_table_coi_; k++)
         {
-            SamplingDepthEntry key{ii, jj};
-            lookup_sampling_depth[key] = 0;
-            for (int kk = jj; kk > 0; --kk)
-            {
-                lookup_sampling_depth[key] += lookup_lgamma[ii + 1] -
-                                              lookup_lgamma[kk + 1] -
-                                              lookup_lgamma[(ii - kk) + 1];
-            }
+            row[k] = row[k - 1] + (k <= n ? log_binomial(n, k) : 0);
+            cost[k] = k <= n ? log_add(cost[k - 1], log_genotypes_cost(n, k))
+                             : cost[k - 1];
         }
     }
 }
 
-double Lookup::get_sampling_depth(int coi, int num_alleles)
+// std::lgamma is not thread safe, the tables are built before any threads
+// start
+double Lookup::log_factorial_slow(int n) const
 {
-    assert(num_alleles <= max_alleles);
-    SamplingDepthEntry key{num_alleles, std::min(coi, num_alleles)};
-    return lookup_sampling_depth[key];
+    double res = log_factorial_.back();
+    for (int d = log_factorial_.size(); d <= n; d++)
+    {
+        res += std::log((double)d);
+    }
+    return res;
+}
+
+double Lookup::get_sampling_depth(int coi, int num_alleles) const
+{
+    assert(num_alleles <= max_alleles_);
+    const int depth = std::min(coi, num_alleles);
+    const int tabulated = std::min(depth, max_table_coi_);
+    double res = sampling_depth_[num_alleles * (max_table_coi_ + 1) + tabulated];
+    for (int k = tabulated + 1; k <= depth; k++)
+    {
+        res += log_binomial(num_alleles, k);
+    }
+    return res;
+}
+
+double Lookup::get_enumeration_cost(int coi, int num_alleles) const
+{
+    assert(num_alleles <= max_alleles_);
+    const int depth = std::min(coi, num_alleles);
+    const int tabulated = std::min(depth, max_table_coi_);
+    double res =
+        enumeration_cost_[num_alleles * (max_table_coi_ + 1) + tabulated];
+    for (int k = tabulated + 1; k <= depth; k++)
+    {
+        res = log_add(res, log_genotypes_cost(num_alleles, k));
+    }
+    return res;
 }
@@ -3,31 +3,71 @@
 #ifndef LOOKUP_H_
 #define LOOKUP_H_
 
-#include "parameters.h"
-
-#include <Rcpp.h>
-#include <map>
-#include <utility>
 #include <vector>
 
+/*
+ * Precomputed terms shared by every chain and thread of a run. Built once
+ * from the largest number of alleles at a locus and read only afterwards,
+ * so it is passed by reference and never copied or locked.
+ */
 class Lookup
 {
-    using SamplingDepthEntry = std::pair<int, int>;
-
    private:
-    bool lgamma_initialized;
-    bool sample_depth_initialized;
-    int max_alleles;
+    int max_alleles_;
+    // COIs beyond the largest tabulated are computed directly
+    int max_table_coi_;
 
-   public:
-    Lookup(int max_alleles);
-    std::vector<double> lookup_lgamma;
-    std::map<SamplingDepthEntry, double> lookup_sampling_depth{};
+    // log(n!) for n in [0, max(max_alleles, max_coi)]
+    std::vector<double> log_factorial_{};
+    // flat (max_alleles + 1) x (max_table_coi + 1), row num_alleles, column
+    // min(coi, num_alleles)
+    std::vector<double> sampling_depth_{};
+    // same layout, log of the inclusion-exclusion terms summed over every
+    // latent genotype
+    std::vector<double> enumeration_cost_{};
 
-    void init_lgamma();
+    void init_log_factorial();
     void init_sampling_depth();
+    double log_factorial_slow(int n) const;
+    double log_genotypes_cost(int n, int k) const;
+
+   public:
+    // COIs up to max_coi are served from the tables
+    static constexpr int max_coi = 32;
+
+    explicit Lookup(int max_alleles);
+
+    Lookup(const Lookup &) = delete;
+    Lookup &operator=(const Lookup &) = delete;
+
+    double log_factorial(int n) const
+    {
+        if (n < (int)log_factorial_.size())
+        {
+            return log_factorial_[n];
+        }
+        return log_factorial_slow(n);
+    }
+
+    // log of the number of ways to choose k of n
+    double log_binomial(int n, int k) const
+    {
+        return log_factorial(n) - log_factorial(k) - log_factorial(n - k);
+    }
+
+    // sum of log_binomial(num_alleles, k) for k in [1, min(coi, num_alleles)]
+    double get_sampling_depth(int coi, int num_alleles) const;
+
+    // inner loop terms of visiting one latent genotype besides its
+    // inclusion-exclusion, the observation likelihood and revolving door
+    // step, measured with bench_kernels
+    static constexpr double enumeration_genotype_cost = 5;
 
-    double get_sampling_depth(int coi, int num_alleles);
+    // log of the inner loop terms exact enumeration takes at coi, a genotype
+    // of k alleles costing enumeration_genotype_cost + 2^k, summed over the
+    // binomial(num_alleles, k) genotypes of each k in
+    // [1, min(coi, num_alleles)]
+    double get_enumeration_cost(int coi, int num_alleles) const;
 };
 
 #endif  // LOOKUP_H_
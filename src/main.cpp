@@ -1,13 +1,205 @@
 
 #include "main.h"
 
+#include "benchmark.h"
 #include "genotyping_data.h"
 #include "lookup.h"
 #include "mcmc_progress_bar.h"
 #include "mcmc_utils.h"
 #include "parameters.h"
+#include "philox.h"
+#include "simulator.h"
+#include "thread_pool.h"
+#include "timer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <memory>
 #include <progress.hpp>
+
+namespace
+{
+// how often driver loops check for interrupts and redraw progress, calling
+// into R every iteration is a measurable cost on fast kernels
+constexpr std::chrono::milliseconds poll_period(100);
+
+Rcpp::List collect_chain_results(const Chain &chain, const TraceSink &trace,
+                                 const GenotypingData &genotyping_data)
+{
+    Rcpp::List debug;
+    debug.push_back(Rcpp::wrap(chain.p_accept));
+    debug.push_back(Rcpp::wrap(chain.m_accept));
+    debug.push_back(Rcpp::wrap(chain.eps_neg_accept));
+    debug.push_back(Rcpp::wrap(chain.eps_pos_accept));
+
+    Rcpp::StringVector debug_names;
+    debug_names.push_back("allele_freq_accept");
+    debug_names.push_back("coi_accept");
+    debug_names.push_back("eps_neg_accept");
+    debug_names.push_back("eps_pos_accept");
+    debug.names() = debug_names;
+
+    Rcpp::List scales;
+    Rcpp::StringVector scale_names;
+    scales.push_back(Rcpp::wrap(chain.p_prop_var));
+    scales.push_back(Rcpp::wrap(chain.m_prop_mean));
+    scales.push_back(Rcpp::wrap(chain.eps_neg_var));
+    scales.push_back(Rcpp::wrap(chain.eps_pos_var));
+    scales.push_back(Rcpp::wrap(chain.mean_coi_var));
+    scale_names.push_back("allele_freq_var");
+    scale_names.push_back("coi_prop_mean");
+    scale_names.push_back("eps_neg_var");
+    scale_names.push_back("eps_pos_var");
+    scale_names.push_back("mean_coi_var");
+    scales.names() = scale_names;
+
+    Rcpp::List res;
+    Rcpp::StringVector res_names;
+    res.push_back(Rcpp::wrap(trace.llik_burnin));
+    res_names.push_back("llik_burnin");
+    trace.collect(res, res_names);
+
+    res.push_back(Rcpp::wrap(genotyping_data.observed_coi));
+    res.push_back(Rcpp::wrap(debug));
+    res.push_back(Rcpp::wrap(scales));
+    res.push_back(Rcpp::wrap(chain.temp));
+    res.push_back(Rcpp::wrap(chain.get_importance_sampling_error()));
+
+    res_names.push_back("observed_coi");
+    res_names.push_back("acceptance_rates");
+    res_names.push_back("proposal_scales");
+    res_names.push_back("temperature");
+    res_names.push_back("importance_sampling_error");
+
+    res.names() = res_names;
+    return res;
+}
+
+Rcpp::List collect_counts(const std::vector<long> &by_coi,
+                          const std::vector<long> &by_alleles)
+{
+    Rcpp::List res;
+    Rcpp::StringVector res_names;
+    res.push_back(
+        Rcpp::wrap(std::vector<double>(by_coi.begin(), by_coi.end())));
+    res.push_back(
+        Rcpp::wrap(std::vector<double>(by_alleles.begin(), by_alleles.end())));
+    res_names.push_back("by_coi");
+    res_names.push_back("by_alleles");
+    res.names() = res_names;
+    return res;
+}
+
+std::vector<double> collect_lookups(const Profile::Lookups &lookups)
+{
+    return {(double)lookups.lookups, (double)lookups.hits};
+}
+
+// counts of every chain, each vector of counts indexed from 0, formatted in
+// R
+Rcpp::List collect_profile(const MCMC &mcmc)
+{
+    Profile profile;
+    for (const auto &chain : mcmc.chains)
+    {
+        profile.merge(chain->get_profile());
+    }
+
+    Rcpp::List marginals;
+    Rcpp::StringVector marginal_names;
+    marginals.push_back(collect_counts(profile.enumeration.by_coi,
+                                       profile.enumeration.by_alleles));
+    marginals.push_back(collect_counts(profile.dynamic_programming.by_coi,
+                                       profile.dynamic_programming.by_alleles));
+    marginals.push_back(collect_counts(profile.importance_sampling.by_coi,
+                                       profile.importance_sampling.by_alleles));
+    marginal_names.push_back("enumeration");
+    marginal_names.push_back("dp");
+    marginal_names.push_back("importance_sampling");
+    marginals.names() = marginal_names;
+
+    // lookups and hits
+    Rcpp::List caches;
+    Rcpp::StringVector cache_names;
+    caches.push_back(Rcpp::wrap(collect_lookups(profile.marginal_cache)));
+    caches.push_back(Rcpp::wrap(collect_lookups(profile.pattern_memo)));
+    caches.push_back(Rcpp::wrap(collect_lookups(profile.latent_memo)));
+    cache_names.push_back("marginal_cache");
+    cache_names.push_back("pattern_memo");
+    cache_names.push_back("latent_memo");
+    caches.names() = cache_names;
+
+    // in the order of ProfiledUpdate
+    const std::vector<std::string> updates{
+        "latent_genotypes", "coi",     "mean_coi", "allele_freqs",
+        "eps",              "eps_pos", "eps_neg",  "individual"};
+
+    Rcpp::List res;
+    Rcpp::StringVector res_names;
+    res.push_back(Rcpp::wrap(updates));
+    res.push_back(Rcpp::wrap(std::vector<double>(profile.update_calls.begin(),
+                                                 profile.update_calls.end())));
+    res.push_back(Rcpp::wrap(std::vector<double>(
+        profile.update_seconds.begin(), profile.update_seconds.end())));
+    res.push_back(marginals);
+    res.push_back(caches);
+    res_names.push_back("update");
+    res_names.push_back("update_calls");
+    res_names.push_back("update_seconds");
+    res_names.push_back("marginals");
+    res_names.push_back("caches");
+    res.names() = res_names;
+    return res;
+}
+
+// one element per rung of the temperature ladder, pooled in R
+Rcpp::List collect_results(const MCMC &mcmc)
+{
+    Rcpp::List chains;
+    for (size_t k = 0; k < mcmc.chains.size(); k++)
+    {
+        chains.push_back(collect_chain_results(
+            *mcmc.chains[k], *mcmc.traces[k], mcmc.genotyping_data));
+    }
+
+    Rcpp::List res;
+    res.push_back(chains);
+    res.push_back(Rcpp::wrap(mcmc.swap_accept));
+    res.push_back(Rcpp::wrap(mcmc.swap_attempts));
+
+    Rcpp::StringVector res_names;
+    res_names.push_back("chains");
+    res_names.push_back("swap_accept");
+    res_names.push_back("swap_attempts");
+
+    res.push_back(Rcpp::wrap(mcmc.burnin_iterations));
+    res.push_back(Rcpp::wrap(mcmc.iterations - mcmc.burnin_iterations));
+    res_names.push_back("burnin_iterations");
+    res_names.push_back("sample_iterations");
+
+    // llik, mean_coi and the heterozygosity of each locus
+    if (mcmc.monitored())
+    {
+        res.push_back(Rcpp::wrap(mcmc.get_rhat()));
+        res.push_back(Rcpp::wrap(mcmc.get_ess()));
+        res_names.push_back("rhat");
+        res_names.push_back("ess");
+    }
+
+    if (mcmc.params.profile)
+    {
+        res.push_back(collect_profile(mcmc));
+        res_names.push_back("profile");
+    }
+
+    res.names() = res_names;
+    return res;
+}
+}  // namespace
+
 //----------------------------------------------
 // [[Rcpp::export(name='run_mcmc_rcpp')]]
 Rcpp::List run_mcmc(Rcpp::List args)
@@ -26,63 +218,220 @@ Rcpp::List run_mcmc(Rcpp::List args)
 
     MCMC mcmc(genotyping_data, lookup, params);
     MCMCProgressBar pb(params.burnin, params.samples);
-    Progress p(params.burnin + params.samples, params.verbose, pb);
+    Progress p(params.burnin + params.samples - mcmc.iterations,
+               params.verbose, pb);
 
-    int step = 0;
-    while (step < params.burnin)
+    // iterations run since progress was last redrawn
+    unsigned long pending = 0;
+    auto refresh_progress = [&]() {
+        pb.set_llik(mcmc.get_llik());
+        p.increment(pending);
+        pending = 0;
+    };
+    Interval<> poll(poll_period);
+    auto poll_progress = [&]() {
+        ++pending;
+        if (poll.elapsed())
+        {
+            Rcpp::checkUserInterrupt();
+            refresh_progress();
+        }
+    };
+
+    // a resumed run continues from the iteration it was checkpointed at
+    int step = std::min(mcmc.iterations, params.burnin);
+    while (step < params.burnin && !mcmc.burnin_converged)
     {
-        Rcpp::checkUserInterrupt();
         mcmc.burnin(step);
         ++step;
-        pb.set_llik(mcmc.get_llik());
-        p.increment();
+        poll_progress();
     }
 
-    step = 0;
-    while (step < params.samples)
+    mcmc.end_burnin();
+
+    step = mcmc.iterations - mcmc.burnin_iterations;
+    while (step < params.samples && !mcmc.sampling_converged)
     {
-        Rcpp::checkUserInterrupt();
         mcmc.sample(step);
         ++step;
-        pb.set_llik(mcmc.get_llik());
-        p.increment();
+        poll_progress();
     }
+    refresh_progress();
+    mcmc.finish();
 
-    Rcpp::List debug;
-    debug.push_back(Rcpp::wrap(mcmc.chain.p_accept));
-    debug.push_back(Rcpp::wrap(mcmc.chain.m_accept));
-    debug.push_back(Rcpp::wrap(mcmc.chain.eps_neg_accept));
-    debug.push_back(Rcpp::wrap(mcmc.chain.eps_pos_accept));
+    return collect_results(mcmc);
+}
 
-    Rcpp::StringVector debug_names;
-    debug_names.push_back("allele_freq_accept");
-    debug_names.push_back("coi_accept");
-    debug_names.push_back("eps_neg_accept");
-    debug_names.push_back("eps_pos_accept");
-    debug.names() = debug_names;
+//----------------------------------------------
+// Run one MCMC per element of args_list, each element being the args of a
+// run_mcmc call. Datasets are scheduled on a shared work stealing pool, each
+// chain running single threaded.
+// [[Rcpp::export(name='run_mcmc_batch_rcpp')]]
+Rcpp::List run_mcmc_batch(Rcpp::List args_list, int num_threads)
+{
+    const size_t num_datasets = args_list.size();
+
+    // everything from R is converted up front, the pool never calls into R
+    std::vector<std::unique_ptr<GenotypingData>> datasets{};
+    std::vector<std::unique_ptr<Lookup>> lookups{};
+    std::vector<std::unique_ptr<MCMC>> runs{};
+    for (size_t d = 0; d < num_datasets; d++)
+    {
+        Rcpp::List args(args_list[d]);
+        Parameters params(args);
+        params.verbose = false;
+        params.num_threads = 1;
+
+        datasets.emplace_back(new GenotypingData(args));
+        lookups.emplace_back(new Lookup(datasets.back()->max_alleles));
+        runs.emplace_back(
+            new MCMC(*datasets.back(), *lookups.back(), params));
+    }
+
+    ThreadPool pool(num_threads > 0 ? num_threads
+                                    : ThreadPool::hardware_threads());
+
+    // only thread 0, the R thread, polls for interrupts, between its
+    // iterations and, once it runs out of datasets, while it waits for the
+    // others. The other threads see them through interrupted
+    std::atomic<bool> interrupted{false};
+    std::exception_ptr interrupt = nullptr;
+    auto poll_interrupt = [&]() {
+        if (interrupted)
+        {
+            return;
+        }
+        try
+        {
+            Rcpp::checkUserInterrupt();
+        }
+        catch (...)
+        {
+            interrupt = std::current_exception();
+            interrupted = true;
+        }
+    };
+    Interval<> poll(poll_period);
+    auto check_interrupt = [&](int thread_id) {
+        if (thread_id == 0 && poll.elapsed())
+        {
+            poll_interrupt();
+        }
+    };
+
+    auto run_dataset = [&](size_t d, int thread_id) {
+        MCMC &mcmc = *runs[d];
+        const int burnin = mcmc.params.burnin;
+        for (int step = std::min(mcmc.iterations, burnin);
+             step < burnin && !mcmc.burnin_converged && !interrupted; ++step)
+        {
+            check_interrupt(thread_id);
+            mcmc.burnin(step);
+        }
+        if (interrupted)
+        {
+            // burnin is not over, flush and checkpoint where it stopped
+            mcmc.finish();
+            return;
+        }
+        mcmc.end_burnin();
+
+        for (int step = mcmc.iterations - mcmc.burnin_iterations;
+             step < mcmc.params.samples && !mcmc.sampling_converged &&
+             !interrupted;
+             ++step)
+        {
+            check_interrupt(thread_id);
+            mcmc.sample(step);
+        }
+        mcmc.finish();
+    };
+    pool.parallel_for_dynamic(num_datasets, run_dataset, poll_interrupt,
+                              poll_period);
+
+    if (interrupt)
+    {
+        std::rethrow_exception(interrupt);
+    }
 
     Rcpp::List res;
-    res.push_back(Rcpp::wrap(mcmc.llik_burnin));
-    res.push_back(Rcpp::wrap(mcmc.llik_sample));
-    res.push_back(Rcpp::wrap(mcmc.m_store));
-    res.push_back(Rcpp::wrap(mcmc.p_store));
-    res.push_back(Rcpp::wrap(mcmc.eps_neg_store));
-    res.push_back(Rcpp::wrap(mcmc.eps_pos_store));
-    res.push_back(Rcpp::wrap(mcmc.mean_coi_store));
-    res.push_back(Rcpp::wrap(mcmc.genotyping_data.observed_coi));
-    res.push_back(Rcpp::wrap(debug));
+    for (const auto &mcmc : runs)
+    {
+        res.push_back(collect_results(*mcmc));
+    }
+    return res;
+}
+
+//----------------------------------------------
+// Time the likelihood kernels at coi and the update sweeps on the data of
+// args, each for at least min_seconds
+// [[Rcpp::export(name='bench_kernels_rcpp')]]
+Rcpp::List bench_kernels(Rcpp::List args, int coi, double min_seconds)
+{
+    Parameters params(args);
+    GenotypingData genotyping_data(args);
+    Lookup lookup(genotyping_data.max_alleles);
 
+    KernelBenchmark benchmark(genotyping_data, lookup, params, coi,
+                              min_seconds);
+    return benchmark.run();
+}
+
+//----------------------------------------------
+// Simulate data from the model, see simulate_genotyping_data
+// [[Rcpp::export(name='simulate_data_rcpp')]]
+Rcpp::List simulate_data(double mean_coi,
+                         std::vector<std::vector<double>> locus_freq_alphas,
+                         int num_samples, double epsilon_pos,
+                         double epsilon_neg, double seed, int num_threads)
+{
+    const SimulatedData simulated = simulate_genotyping_data(
+        mean_coi, locus_freq_alphas, num_samples, epsilon_pos, epsilon_neg,
+        seed,
+        num_threads > 0 ? num_threads : ThreadPool::hardware_threads());
+
+    Rcpp::List res;
     Rcpp::StringVector res_names;
-    res_names.push_back("llik_burnin");
-    res_names.push_back("llik_sample");
-    res_names.push_back("coi");
+    res.push_back(Rcpp::wrap(simulated.observed));
+    res.push_back(Rcpp::wrap(simulated.allele_freqs));
+    res.push_back(Rcpp::wrap(simulated.sample_cois));
+    res.push_back(Rcpp::wrap(simulated.true_genotypes));
+    res_names.push_back("data");
     res_names.push_back("allele_freqs");
-    res_names.push_back("eps_neg");
-    res_names.push_back("eps_pos");
-    res_names.push_back("mean_coi");
-    res_names.push_back("observed_coi");
-    res_names.push_back("acceptance_rates");
-
+    res_names.push_back("sample_cois");
+    res_names.push_back("true_genotypes");
     res.names() = res_names;
     return res;
 }
+
+//----------------------------------------------
+// One Philox4x32-10 block of counter under key, words given and returned as
+// hex strings, for checking the generator against known answers
+// [[Rcpp::export(name='philox_block_rcpp')]]
+std::vector<std::string> philox_block(std::vector<std::string> counter,
+                                      std::vector<std::string> key)
+{
+    Philox::counter_t ctr{};
+    Philox::key_t k{};
+    if (counter.size() != ctr.size() || key.size() != k.size())
+    {
+        Rcpp::stop("counter must have 4 words and key 2");
+    }
+    for (size_t i = 0; i < ctr.size(); i++)
+    {
+        ctr[i] = std::stoul(counter[i], nullptr, 16);
+    }
+    for (size_t i = 0; i < k.size(); i++)
+    {
+        k[i] = std::stoul(key[i], nullptr, 16);
+    }
+
+    std::vector<std::string> res{};
+    char word[9];
+    for (const uint32_t x : Philox::block(ctr, k))
+    {
+        std::snprintf(word, sizeof word, "%08x", (unsigned)x);
+        res.push_back(word);
+    }
+    return res;
+}
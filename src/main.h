@@ -7,4 +7,16 @@
 
 Rcpp::List run_mcmc(Rcpp::List args);
 
+Rcpp::List run_mcmc_batch(Rcpp::List args_list, int num_threads);
+
+Rcpp::List bench_kernels(Rcpp::List args, int coi, double min_seconds);
+
+Rcpp::List simulate_data(double mean_coi,
+                         std::vector<std::vector<double>> locus_freq_alphas,
+                         int num_samples, double epsilon_pos,
+                         double epsilon_neg, double seed, int num_threads);
+
+std::vector<std::string> philox_block(std::vector<std::string> counter,
+                                      std::vector<std::string> key);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "marginal_cache.h"
+
+void MarginalCache::resize(size_t num_loci, size_t num_samples)
+{
+    num_samples_ = num_samples;
+
+    // versions start at 1 so the zeroed slots are stale
+    slots_.assign(num_loci * num_samples * slots_per_pair, Slot{0, 0, 0, 0});
+    next_slot_.assign(num_loci * num_samples, 0);
+    locus_version_.assign(num_loci, 1);
+    sample_version_.assign(num_samples, 1);
+}
+
+const double *MarginalCache::find(size_t locus, size_t sample, int coi) const
+{
+    const Slot *slots = &slots_[pair_index(locus, sample) * slots_per_pair];
+    for (int s = 0; s < slots_per_pair; s++)
+    {
+        if (slots[s].coi == coi &&
+            slots[s].locus_version == locus_version_[locus] &&
+            slots[s].sample_version == sample_version_[sample])
+        {
+            return &slots[s].llik;
+        }
+    }
+    return nullptr;
+}
+
+void MarginalCache::store(size_t locus, size_t sample, int coi, double llik)
+{
+    const size_t pair = pair_index(locus, sample);
+    Slot *slots = &slots_[pair * slots_per_pair];
+
+    // reuse the slot already holding coi, otherwise replace round robin
+    int s = 0;
+    while (s < slots_per_pair && slots[s].coi != coi)
+    {
+        s++;
+    }
+    if (s == slots_per_pair)
+    {
+        s = next_slot_[pair];
+        next_slot_[pair] = (s + 1) % slots_per_pair;
+    }
+
+    slots[s] = Slot{llik, locus_version_[locus], sample_version_[sample], coi};
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef MARGINAL_CACHE_H_
+#define MARGINAL_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Marginal likelihoods of each (locus, sample) pair for the last few COI
+ * values they were evaluated at. Entries are tagged with the version of the
+ * locus' allele frequencies and of the sample's error rates they were
+ * computed under; bumping either version invalidates every entry depending
+ * on it without touching them.
+ *
+ * Entries of a pair are only read or written by the update owning that
+ * locus or sample, so concurrent per-locus or per-sample updates need no
+ * locking.
+ */
+class MarginalCache
+{
+   public:
+    // COI values remembered per (locus, sample)
+    static constexpr int slots_per_pair = 4;
+
+    void resize(size_t num_loci, size_t num_samples);
+
+    // cached marginal, nullptr if absent or stale
+    const double *find(size_t locus, size_t sample, int coi) const;
+
+    void store(size_t locus, size_t sample, int coi, double llik);
+
+    // the allele frequencies of locus changed
+    void invalidate_locus(size_t locus) { ++locus_version_[locus]; }
+
+    // the error rates of sample changed
+    void invalidate_sample(size_t sample) { ++sample_version_[sample]; }
+
+   private:
+    struct Slot
+    {
+        double llik;
+        uint32_t locus_version;
+        uint32_t sample_version;
+        int coi;
+    };
+
+    size_t num_samples_ = 0;
+    std::vector<Slot> slots_{};
+    // slot of each pair to replace next
+    std::vector<uint8_t> next_slot_{};
+    std::vector<uint32_t> locus_version_{};
+    std::vector<uint32_t> sample_version_{};
+
+    size_t pair_index(size_t locus, size_t sample) const
+    {
+        return locus * num_samples_ + sample;
+    }
+};
+
+#endif  // MARGINAL_CACHE_H_
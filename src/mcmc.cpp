@@ -1,58 +1,311 @@
 #include "mcmc.h"
 
 #include "chain.h"
+#include "checkpoint.h"
 #include "mcmc_utils.h"
+#include "trace_file.h"
+#include "trace_summary.h"
 
 #include <Rcpp.h>
+#include <algorithm>
+#include <stdexcept>
 
-MCMC::MCMC(GenotypingData genotyping_data, Lookup lookup, Parameters params)
-    : genotyping_data(genotyping_data),
+MCMC::MCMC(const GenotypingData &genotyping_data, const Lookup &lookup,
+           Parameters params)
+    : pool_(new ThreadPool(std::min(params.n_chains, params.num_threads))),
+      sampler(lookup),
+      genotyping_data(genotyping_data),
       lookup(lookup),
-      params(params),
-      chain(genotyping_data, lookup, params)
+      params(params)
 {
-    p_store.resize(genotyping_data.num_loci);
-    m_store.resize(genotyping_data.num_samples);
-    eps_neg_store.resize(genotyping_data.num_samples);
-    eps_pos_store.resize(genotyping_data.num_samples);
+    Parameters chain_params = params;
+    chain_params.num_threads =
+        std::max(1, params.num_threads / params.n_chains);
+
+    for (int k = 0; k < params.n_chains; k++)
+    {
+        chains.emplace_back(new Chain(genotyping_data, lookup, chain_params,
+                                      params.temperatures[k], k));
+    }
+    swap_accept.resize(params.n_chains - 1, 0);
+
+    for (int k = 0; k < params.n_chains; k++)
+    {
+        if (params.temperatures[k] == 1)
+        {
+            cold_chains_.push_back(k);
+        }
+    }
+    if (params.target_rhat > 0 || params.target_ess > 0)
+    {
+        monitor_.reset(new ConvergenceMonitor(cold_chains_.size(),
+                                              genotyping_data.num_loci));
+    }
+
+    if (!params.resume_file.empty())
+    {
+        read_checkpoint(params.resume_file);
+    }
+
+    // draws still to be retained, every thin'th of the samples starting
+    // with the first
+    const int first_sample =
+        burnin_iterations < 0 ? 0 : iterations - burnin_iterations;
+    auto draws_before = [&](int step) {
+        return params.thin == 0 ? step
+                                : (step + params.thin - 1) / params.thin;
+    };
+    const int num_draws =
+        draws_before(params.samples) - draws_before(first_sample);
+
+    for (int k = 0; k < params.n_chains; k++)
+    {
+        if (params.summary_only)
+        {
+            traces.emplace_back(new SummaryTraceSink(
+                genotyping_data, params.summary_quantiles));
+        }
+        else if (params.trace_files.empty())
+        {
+            traces.emplace_back(
+                new MemoryTraceSink(genotyping_data, num_draws));
+        }
+        else
+        {
+            traces.emplace_back(new FileTraceSink(
+                genotyping_data, params.trace_files[k], params.compress_trace));
+        }
+    }
 };
 
+void MCMC::update_chains(int iteration)
+{
+    pool_->parallel_for(chains.size(), [&](size_t k, int /*thread*/) {
+        Chain &chain = *chains[k];
+        if (params.marginal_method == MarginalMethod::DataAugmentation)
+        {
+            chain.update_latent_genotypes(iteration);
+        }
+        chain.update_eps_neg(iteration);
+        chain.update_eps_pos(iteration);
+        chain.update_p(iteration);
+        chain.update_m(iteration);
+        chain.update_individual_parameters(iteration);
+        chain.update_mean_coi(iteration);
+        chain.resync_llik(iteration);
+    });
+}
+
+/*
+ * Propose exchanging the states of each pair of neighbouring rungs at
+ * different temperatures. The
+ * priors are the same at every temperature, so only the tempered data
+ * likelihoods enter the acceptance ratio.
+ */
+void MCMC::swap_chains(int iteration)
+{
+    if (chains.size() < 2 || (iteration + 1) % params.swap_interval != 0)
+    {
+        return;
+    }
+
+    sampler.seed(params.seed, Sampler::stream_id(RandomStream::Swap, 0),
+                 iteration);
+    swap_attempts++;
+    for (size_t k = 0; k + 1 < chains.size(); k++)
+    {
+        Chain &cold = *chains[k];
+        Chain &hot = *chains[k + 1];
+
+        // untempered replicates stay separate so their traces stay intact
+        if (cold.temp == hot.temp)
+        {
+            continue;
+        }
+
+        const double log_ratio = (1 / cold.temp - 1 / hot.temp) *
+                                 (hot.get_data_llik() - cold.get_data_llik());
+
+        if (sampler.sample_log_mh_acceptance() <= log_ratio)
+        {
+            std::swap(chains[k], chains[k + 1]);
+            std::swap(chains[k]->temp, chains[k + 1]->temp);
+            swap_accept[k] += 1;
+        }
+    }
+}
+
 void MCMC::burnin(int step)
 {
-    chain.update_eps_neg(step);
-    chain.update_eps_pos(step);
-    chain.update_p(step);
-    chain.update_m(step);
-    chain.update_individual_parameters(step);
-    chain.update_mean_coi(step);
-    llik_burnin.push_back(chain.get_llik());
+    update_chains(step);
+    swap_chains(step);
+    for (size_t k = 0; k < chains.size(); k++)
+    {
+        traces[k]->record_burnin(*chains[k]);
+    }
+
+    // compare halves of the latter half of burnin, as BDA discards the
+    // first half as warmup
+    if (params.target_rhat > 0)
+    {
+        monitor_chains();
+        const int completed = step + 1;
+        if (completed % params.convergence_interval == 0)
+        {
+            const auto rhat = monitor_->split_rhat(completed / 2);
+            burnin_converged = std::all_of(
+                rhat.begin(), rhat.end(),
+                [&](double r) { return r < params.target_rhat; });
+        }
+    }
+    checkpoint_if_due(step + 1);
+}
+
+void MCMC::end_burnin()
+{
+    if (burnin_iterations >= 0)
+    {
+        return;
+    }
+    burnin_iterations = iterations;
+    for (auto &chain : chains)
+    {
+        chain->end_adaptation();
+    }
+    if (monitor_)
+    {
+        monitor_->clear();
+    }
 }
 
 void MCMC::sample(int step)
 {
-    chain.update_eps_neg(params.burnin + step);
-    chain.update_eps_pos(params.burnin + step);
-    chain.update_p(params.burnin + step);
-    chain.update_m(params.burnin + step);
-    chain.update_individual_parameters(params.burnin + step);
-    chain.update_mean_coi(params.burnin + step);
+    update_chains(burnin_iterations + step);
+    swap_chains(burnin_iterations + step);
 
     if (params.thin == 0 || step % params.thin == 0)
     {
-        for (size_t ii = 0; ii < genotyping_data.num_loci; ++ii)
+        for (size_t k = 0; k < chains.size(); k++)
+        {
+            traces[k]->record(*chains[k]);
+        }
+
+        if (monitor_)
         {
-            p_store[ii].push_back(chain.p[ii]);
+            monitor_chains();
         }
+    }
+
+    // every convergence_interval iterations as in burnin, whatever thin is
+    if (params.target_ess > 0 &&
+        (step + 1) % params.convergence_interval == 0 &&
+        monitor_->length() > 0)
+    {
+        const auto ess = monitor_->ess();
+        sampling_converged =
+            std::all_of(ess.begin(), ess.end(),
+                        [&](double e) { return e >= params.target_ess; });
+    }
+    checkpoint_if_due(burnin_iterations + step + 1);
+}
 
-        for (size_t jj = 0; jj < genotyping_data.num_samples; ++jj)
+void MCMC::monitor_chains()
+{
+    for (size_t c = 0; c < cold_chains_.size(); c++)
+    {
+        monitor_->record(c, *chains[cold_chains_[c]]);
+    }
+}
+
+std::vector<double> MCMC::get_rhat() const { return monitor_->split_rhat(); }
+
+std::vector<double> MCMC::get_ess() const { return monitor_->ess(); }
+
+void MCMC::finish()
+{
+    for (auto &trace : traces)
+    {
+        trace->finish();
+    }
+
+    // so the run can later be extended
+    if (!params.checkpoint_file.empty() &&
+        iterations % params.checkpoint_interval != 0)
+    {
+        write_checkpoint();
+    }
+}
+
+void MCMC::checkpoint_if_due(int completed)
+{
+    iterations = completed;
+    if (!params.checkpoint_file.empty() &&
+        iterations % params.checkpoint_interval == 0)
+    {
+        write_checkpoint();
+    }
+}
+
+/*
+ * The state of every chain, in ladder order, after iterations iterations.
+ * Draws are not checkpointed, a resumed run only returns those made after
+ * it resumed.
+ */
+void MCMC::write_checkpoint() const
+{
+    CheckpointWriter out(params.checkpoint_file, params.checkpoint_args);
+    out.write((int32_t)iterations);
+    out.write(params.seed);
+    out.write((int32_t)chains.size());
+    out.write((int32_t)swap_attempts);
+    out.write(swap_accept);
+    out.write((int32_t)burnin_iterations);
+    out.write((int32_t)burnin_converged);
+    out.write((int32_t)sampling_converged);
+    for (const auto &chain : chains)
+    {
+        chain->write_state(out);
+    }
+    out.write((int32_t)(monitor_ != nullptr));
+    if (monitor_)
+    {
+        monitor_->write_state(out);
+    }
+    out.commit();
+}
+
+void MCMC::read_checkpoint(const std::string &path)
+{
+    CheckpointReader in(path);
+    iterations = in.read<int32_t>();
+    if (in.read<uint64_t>() != params.seed ||
+        in.read<int32_t>() != (int32_t)chains.size())
+    {
+        throw std::runtime_error("Checkpoint " + path +
+                                 " is from a different run");
+    }
+    swap_attempts = in.read<int32_t>();
+    in.read(swap_accept);
+    burnin_iterations = in.read<int32_t>();
+    burnin_converged = in.read<int32_t>();
+    // extending a run that stopped on its ESS target disables the target
+    sampling_converged = in.read<int32_t>() && params.target_ess > 0;
+    for (auto &chain : chains)
+    {
+        chain->read_state(in);
+    }
+    if (in.read<int32_t>())
+    {
+        if (monitor_)
+        {
+            monitor_->read_state(in);
+        }
+        else
         {
-            m_store[jj].push_back(chain.m[jj]);
-            eps_neg_store[jj].push_back(chain.eps_neg[jj]);
-            eps_pos_store[jj].push_back(chain.eps_pos[jj]);
+            ConvergenceMonitor(cold_chains_.size(), genotyping_data.num_loci)
+                .read_state(in);
         }
-        mean_coi_store.push_back(chain.mean_coi);
-        llik_sample.push_back(chain.get_llik());
     }
 }
 
-double MCMC::get_llik() { return chain.get_llik(); }
+double MCMC::get_llik() { return chains[0]->get_llik(); }
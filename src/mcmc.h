@@ -4,36 +4,78 @@
 #define MCMC_H_
 
 #include "chain.h"
+#include "convergence_monitor.h"
 #include "genotyping_data.h"
 #include "lookup.h"
 #include "parameters.h"
+#include "sampler.h"
+#include "thread_pool.h"
+#include "trace_sink.h"
 
 #include <Rcpp.h>
+#include <memory>
 #include <progress.hpp>
 
 class MCMC
 {
    private:
+    // runs the chains concurrently, each chain gets an equal share of the
+    // remaining threads for its own updates
+    std::unique_ptr<ThreadPool> pool_;
+    Sampler sampler;
+
+    void update_chains(int iteration);
+    void swap_chains(int iteration);
+
+    // untempered rungs of the ladder, followed by monitor_ when a
+    // convergence target is set
+    std::vector<size_t> cold_chains_{};
+    std::unique_ptr<ConvergenceMonitor> monitor_{};
+    void monitor_chains();
+
+    // count completed iterations, writing a checkpoint if one is due
+    void checkpoint_if_due(int completed);
+    void write_checkpoint() const;
+    void read_checkpoint(const std::string &path);
+
    public:
-    GenotypingData genotyping_data;
-    Lookup lookup;
+    const GenotypingData &genotyping_data;
+    const Lookup &lookup;
     Parameters params;
-    Chain chain;
 
-    std::vector<std::vector<int>> m_store{};
-    std::vector<std::vector<std::vector<double>>> p_store{};
-    std::vector<std::vector<double>> eps_pos_store{};
-    std::vector<std::vector<double>> eps_neg_store{};
-    std::vector<double> mean_coi_store{};
+    // chains[k] runs at params.temperatures[k], chains[0] is the cold chain.
+    // Swaps exchange the chains' states, so traces[k] always follows the
+    // chain at temperature k
+    std::vector<std::unique_ptr<Chain>> chains{};
+    std::vector<std::unique_ptr<TraceSink>> traces{};
+
+    // swaps accepted between rung k and k + 1, out of swap_attempts
+    std::vector<int> swap_accept{};
+    int swap_attempts = 0;
 
-    std::vector<double> llik_burnin{};
-    std::vector<double> llik_sample{};
+    // iterations run so far, burnin then sampling, including those restored
+    // from params.resume_file
+    int iterations = 0;
+    // iterations of burnin, -1 until it is over
+    int burnin_iterations = -1;
+    // the targets of params are met, ending burnin or sampling early
+    bool burnin_converged = false;
+    bool sampling_converged = false;
 
     void burnin(int step);
+    // called once, when burnin ends or converges
+    void end_burnin();
     void sample(int step);
+    // diagnostics of the retained draws, for monitored runs
+    bool monitored() const { return monitor_ != nullptr; };
+    std::vector<double> get_rhat() const;
+    std::vector<double> get_ess() const;
+    // flush the traces and write a last checkpoint once sampling is over
+    void finish();
     double get_llik();
 
-    MCMC(GenotypingData genotyping_data, Lookup lookup, Parameters params);
+    MCMC(const GenotypingData &genotyping_data, const Lookup &lookup,
+         Parameters params);
 };
 
 #endif  // MCMC_H_
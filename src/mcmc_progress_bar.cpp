@@ -2,6 +2,9 @@
 
 #include "mcmc_utils.h"
 
+#include <cmath>
+#include <cstdio>
+
 MCMCProgressBar::MCMCProgressBar(int burnin, int sample)
     : burnin_(burnin), sample_(sample)
 {
@@ -29,18 +32,18 @@ void MCMCProgressBar::update(float progress)
         clock_.tock();
         auto duration = clock_.duration();
 
-        std::string time_string =
-            time_remaining_string_(duration.count(), progress);
-        std::string ticks_string = current_ticks_string_(progress);
-        std::string llik_string = current_llik_string_();
-        std::string empty_space = std::string(time_string.length(), ' ');
-
-        std::stringstream ss;
-        ss << "|" << ticks_string << "| " << time_string << llik_string
-           << empty_space;
+        line_.clear();
+        line_ += '|';
+        append_ticks_(progress);
+        line_ += "| ";
+        const size_t time_begin = line_.size();
+        append_time_remaining_(duration.count(), progress);
+        const size_t time_length = line_.size() - time_begin;
+        append_llik_();
+        line_.append(time_length, ' ');
 
         // clear console line and update
-        UtilFunctions::rewrite_line(ss.str());
+        UtilFunctions::rewrite_line(line_.c_str());
 
         if (progress == 1)
         {
@@ -51,7 +54,7 @@ void MCMCProgressBar::update(float progress)
 
 void MCMCProgressBar::end_display() { update(1); };
 
-std::string MCMCProgressBar::time_remaining_string_(double dur, float progress)
+void MCMCProgressBar::append_time_remaining_(double dur, float progress)
 {
     double rem_time = (dur / progress) * (1 - progress);
     int hour = 0;
@@ -66,24 +69,25 @@ std::string MCMCProgressBar::time_remaining_string_(double dur, float progress)
 
     sec = rem_time / 1000;
 
-    std::stringstream ss;
-    if (hour != 0) ss << hour << "h ";
-    if (min != 0 or hour != 0) ss << min << "m ";
-    ss << sec << "s ";
-    std::string time_str = ss.str();
-    return time_str;
+    char buf[64];
+    if (hour != 0)
+    {
+        std::snprintf(buf, sizeof buf, "%dh %dm %ds ", hour, min, sec);
+    }
+    else if (min != 0)
+    {
+        std::snprintf(buf, sizeof buf, "%dm %ds ", min, sec);
+    }
+    else
+    {
+        std::snprintf(buf, sizeof buf, "%ds ", sec);
+    }
+    line_ += buf;
 };
 
-std::string MCMCProgressBar::current_ticks_string_(float progress)
-{
-    int ticks_remaining = (int)(progress * max_ticks_);
-    return construct_ticks_display_string_(ticks_remaining);
-}
-
-std::string MCMCProgressBar::construct_ticks_display_string_(int ticks)
+void MCMCProgressBar::append_ticks_(float progress)
 {
-    std::stringstream ss;
-
+    int ticks = (int)(progress * max_ticks_);
     int burnin_tick =
         (int)(((double)burnin_ / (burnin_ + sample_)) * max_ticks_);
 
@@ -91,25 +95,24 @@ std::string MCMCProgressBar::construct_ticks_display_string_(int ticks)
     {
         if (i == burnin_tick)
         {
-            ss << "B";
+            line_ += 'B';
         }
         else if (i < ticks)
         {
-            ss << "*";
+            line_ += '*';
         }
         else
         {
-            ss << " ";
+            line_ += ' ';
         }
     }
-    return ss.str();
 }
 
-std::string MCMCProgressBar::current_llik_string_()
+void MCMCProgressBar::append_llik_()
 {
-    std::stringstream ss;
-    ss << "(Llik: " << llik_ << ")";
-    return ss.str();
+    char buf[64];
+    std::snprintf(buf, sizeof buf, "(Llik: %g)", llik_);
+    line_ += buf;
 }
 
 void MCMCProgressBar::finalize_display_()
@@ -6,6 +6,7 @@
 #include <Rcpp.h>
 
 #include <progress_bar.hpp>
+#include <string>
 
 class MCMCProgressBar : public ProgressBar
 {
@@ -19,19 +20,20 @@ class MCMCProgressBar : public ProgressBar
     void set_llik(double llik);
 
    private:
-    std::string time_remaining_string_(double dur, float progress);
-    std::string current_ticks_string_(float progress);
-    std::string current_llik_string_();
-    std::string construct_ticks_display_string_(int ticks);
+    void append_time_remaining_(double dur, float progress);
+    void append_ticks_(float progress);
+    void append_llik_();
     void finalize_display_();
 
     int max_ticks_ = 50;
     int burnin_;
     int sample_;
-    double llik_;
+    double llik_ = 0;
     Timer<> clock_;
     bool finalized_ = false;
     bool timer_flag_ = false;
+    // the line being drawn, reused across updates
+    std::string line_{};
 };
 
 #endif /* MCMC_PROGRESS_BAR_H */
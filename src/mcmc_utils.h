@@ -5,6 +5,7 @@
 
 #include <Rcpp.h>
 #include <algorithm>
+#include <limits>
 
 #include <boost/math/distributions.hpp>
 #include <boost/random.hpp>
@@ -280,6 +281,24 @@ inline std::vector<double> logitScale(std::vector<double> &x, double scale)
     return out;
 }
 
+// log of the sum of the exponentials of [first, last), -inf if all are
+template <class It>
+inline double logSumExp(It first, It last)
+{
+    const double max = *std::max_element(first, last);
+    if (max == -std::numeric_limits<double>::infinity())
+    {
+        return max;
+    }
+
+    double sum = 0;
+    for (It it = first; it != last; ++it)
+    {
+        sum += std::exp(*it - max);
+    }
+    return max + std::log(sum);
+}
+
 template <class T>
 inline double expit(const T x)
 {
@@ -3,6 +3,8 @@
 
 #include "mcmc_utils.h"
 
+#include <cmath>
+
 Parameters::Parameters(const Rcpp::List &args)
 {
     // MCMC
@@ -10,12 +12,112 @@ Parameters::Parameters(const Rcpp::List &args)
     thin = UtilFunctions::r_to_int(args["thin"]);
     burnin = UtilFunctions::r_to_int(args["burnin"]);
     samples = UtilFunctions::r_to_int(args["samples"]);
+    num_threads = UtilFunctions::r_to_int(args["num_threads"]);
+    seed = UtilFunctions::r_to_double(args["seed"]);
     complexity_limit = UtilFunctions::r_to_int(args["complexity_limit"]);
     importance_sampling_depth =
         UtilFunctions::r_to_int(args["importance_sampling_depth"]);
     importance_sampling_scaling_factor =
         UtilFunctions::r_to_double(args["importance_sampling_scaling_factor"]);
 
+    std::string method = UtilFunctions::r_to_string(args["marginal_method"]);
+    if (method == "auto")
+    {
+        marginal_method = MarginalMethod::Auto;
+    }
+    else if (method == "dp")
+    {
+        marginal_method = MarginalMethod::DynamicProgramming;
+    }
+    else if (method == "enumeration")
+    {
+        marginal_method = MarginalMethod::Enumeration;
+    }
+    else if (method == "importance_sampling")
+    {
+        marginal_method = MarginalMethod::ImportanceSampling;
+    }
+    else if (method == "data_augmentation")
+    {
+        marginal_method = MarginalMethod::DataAugmentation;
+    }
+    else
+    {
+        Rcpp::stop("Unknown marginal_method: " + method);
+    }
+
+    std::string sampler =
+        UtilFunctions::r_to_string(args["importance_sampler"]);
+    if (sampler == "standard")
+    {
+        importance_sampler = ImportanceSampler::Standard;
+    }
+    else if (sampler == "variance_reduced")
+    {
+        importance_sampler = ImportanceSampler::VarianceReduced;
+    }
+    else
+    {
+        Rcpp::stop("Unknown importance_sampler: " + sampler);
+    }
+
+    n_chains = UtilFunctions::r_to_int(args["n_chains"]);
+    temperatures = UtilFunctions::r_to_vector_double(args["temperatures"]);
+    swap_interval = UtilFunctions::r_to_int(args["swap_interval"]);
+    if ((int)temperatures.size() != n_chains)
+    {
+        Rcpp::stop("temperatures must have one value per chain");
+    }
+    if (swap_interval < 1)
+    {
+        Rcpp::stop("swap_interval must be positive");
+    }
+
+    target_rhat = UtilFunctions::r_to_double(args["target_rhat"]);
+    target_ess = UtilFunctions::r_to_double(args["target_ess"]);
+    convergence_interval =
+        UtilFunctions::r_to_int(args["convergence_interval"]);
+    if (convergence_interval < 1)
+    {
+        Rcpp::stop("convergence_interval must be positive");
+    }
+    adapt_proposals = UtilFunctions::r_to_bool(args["adapt_proposals"]);
+    coi_tries = UtilFunctions::r_to_int(args["coi_tries"]);
+    if (coi_tries < 1)
+    {
+        Rcpp::stop("coi_tries must be positive");
+    }
+    profile = UtilFunctions::r_to_bool(args["profile"]);
+
+    trace_files = UtilFunctions::r_to_vector_string(args["trace_files"]);
+    compress_trace = UtilFunctions::r_to_bool(args["compress_trace"]);
+    if (!trace_files.empty() && (int)trace_files.size() != n_chains)
+    {
+        Rcpp::stop("trace_files must have one file per chain");
+    }
+    summary_only = UtilFunctions::r_to_bool(args["summary_only"]);
+    summary_quantiles =
+        UtilFunctions::r_to_vector_double(args["summary_quantiles"]);
+
+    checkpoint_file = UtilFunctions::r_to_string(args["checkpoint_file"]);
+    checkpoint_interval = UtilFunctions::r_to_int(args["checkpoint_interval"]);
+    Rcpp::RawVector raw_args(args["checkpoint_args"]);
+    checkpoint_args.assign(raw_args.begin(), raw_args.end());
+    resume_file = UtilFunctions::r_to_string(args["resume_file"]);
+    if (checkpoint_interval < 1)
+    {
+        Rcpp::stop("checkpoint_interval must be positive");
+    }
+
+    initial_coi = UtilFunctions::r_to_vector_int(args["initial_coi"]);
+    initial_eps_neg =
+        UtilFunctions::r_to_vector_double(args["initial_eps_neg"]);
+    initial_eps_pos =
+        UtilFunctions::r_to_vector_double(args["initial_eps_pos"]);
+    initial_allele_freqs = Rcpp::as<std::vector<std::vector<double>>>(
+        args["initial_allele_freqs"]);
+    initial_mean_coi = UtilFunctions::r_to_double(args["initial_mean_coi"]);
+
     // Model
     // mean_coi = UtilFunctions::r_to_int(args["mean_coi"]);
     mean_coi_var = UtilFunctions::r_to_double(args["mean_coi_var"]);
@@ -34,4 +136,16 @@ Parameters::Parameters(const Rcpp::List &args)
     eps_neg_beta = UtilFunctions::r_to_double(args["eps_neg_beta"]);
     eps_neg_var = UtilFunctions::r_to_double(args["eps_neg_var"]);
     allele_freq_var = UtilFunctions::r_to_double(args["allele_freq_var"]);
+    set_prior_normalizers();
 };
+
+void Parameters::set_prior_normalizers()
+{
+    auto log_beta = [](double alpha, double beta) {
+        return std::lgamma(alpha) + std::lgamma(beta) -
+               std::lgamma(alpha + beta);
+    };
+    eps_pos_log_beta = log_beta(eps_pos_alpha, eps_pos_beta);
+    eps_neg_log_beta = log_beta(eps_neg_alpha, eps_neg_beta);
+    mean_coi_prior_log_gamma = std::lgamma(mean_coi_prior_shape);
+}
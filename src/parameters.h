@@ -2,6 +2,26 @@
 #define PARAMETERS_H_
 
 #include <Rcpp.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Strategy used to integrate over the latent genotype
+enum class MarginalMethod
+{
+    Auto,                // cheapest exact method
+    DynamicProgramming,  // polynomial DP over alleles x draws
+    Enumeration,         // enumerate latent sets, IS above complexity_limit
+    ImportanceSampling,  // always importance sample
+    DataAugmentation     // sample the latent genotypes along with the rest
+};
+
+// Estimator used when the marginal is importance sampled
+enum class ImportanceSampler
+{
+    Standard,        // independent draws from the reweighted frequencies
+    VarianceReduced  // exact small sets, quasi Monte Carlo for the rest
+};
 
 class Parameters
 {
@@ -11,9 +31,65 @@ class Parameters
     int thin;
     int burnin;
     int samples;
+    int num_threads;
+    uint64_t seed;
     int complexity_limit;
     int importance_sampling_depth;
     double importance_sampling_scaling_factor;
+    MarginalMethod marginal_method;
+    ImportanceSampler importance_sampler;
+
+    // Parallel tempering, one chain per temperature with temperatures[0] the
+    // cold chain. Neighbouring chains attempt a swap every swap_interval
+    // iterations
+    int n_chains;
+    std::vector<double> temperatures;
+    int swap_interval;
+
+    // end burnin early once the split R-hat of every monitored quantity is
+    // under target_rhat, and sampling once every effective sample size
+    // reaches target_ess, checking every convergence_interval iterations. 0
+    // disables either, burnin and samples remain the maximums
+    double target_rhat;
+    double target_ess;
+    int convergence_interval;
+
+    // tune the proposal scales towards a target acceptance rate during
+    // burnin, fixing them for sampling
+    bool adapt_proposals;
+
+    // COIs proposed per sample by each multiple-try COI update, 1 for a
+    // plain Metropolis-Hastings update
+    int coi_tries;
+
+    // count the time spent in each update, the marginals evaluated and
+    // the cache hits, see Profile
+    bool profile;
+
+    // one file per chain to stream draws to, empty to keep them in memory
+    std::vector<std::string> trace_files;
+    bool compress_trace;
+
+    // keep streaming summaries at these probabilities instead of the draws
+    bool summary_only;
+    std::vector<double> summary_quantiles;
+
+    // checkpoint the run to checkpoint_file every checkpoint_interval
+    // iterations and once it is over, empty to not checkpoint. The
+    // serialized R arguments of the run are stored with it
+    std::string checkpoint_file;
+    int checkpoint_interval;
+    std::vector<char> checkpoint_args;
+    // checkpoint to continue from, empty to start afresh
+    std::string resume_file;
+
+    // warm start, one value per sample or locus or empty for none. Samples
+    // and loci whose value is 0, NaN or empty start from the defaults
+    std::vector<int> initial_coi;
+    std::vector<double> initial_eps_neg;
+    std::vector<double> initial_eps_pos;
+    std::vector<std::vector<double>> initial_allele_freqs;
+    double initial_mean_coi;
 
     // Model Parameters
     // Complexity of Infection
@@ -38,6 +114,15 @@ class Parameters
 
     double allele_freq_var;
 
+    // log normalizers of the priors, log B(alpha, beta) of each error rate
+    // and log Gamma(shape) of the mean COI. std::lgamma is not thread safe,
+    // so they are computed here once rather than by every prior evaluation
+    // on the ThreadPool
+    double eps_pos_log_beta;
+    double eps_neg_log_beta;
+    double mean_coi_prior_log_gamma;
+    void set_prior_normalizers();
+
     // constructors
     Parameters(){};
     Parameters(const Rcpp::List &args);
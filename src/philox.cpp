@@ -0,0 +1,50 @@
+#include "philox.h"
+
+namespace
+{
+constexpr uint32_t PHILOX_M0 = 0xD2511F53;
+constexpr uint32_t PHILOX_M1 = 0xCD9E8D57;
+constexpr uint32_t PHILOX_W0 = 0x9E3779B9;
+constexpr uint32_t PHILOX_W1 = 0xBB67AE85;
+constexpr int PHILOX_ROUNDS = 10;
+
+inline void mulhilo(uint32_t a, uint32_t b, uint32_t &hi, uint32_t &lo)
+{
+    const uint64_t product = (uint64_t)a * b;
+    hi = product >> 32;
+    lo = (uint32_t)product;
+}
+}  // namespace
+
+void Philox::seed(uint64_t key, uint64_t stream, uint32_t substream)
+{
+    key_ = {(uint32_t)key, (uint32_t)(key >> 32)};
+    counter_ = {0, substream, (uint32_t)stream, (uint32_t)(stream >> 32)};
+    index_ = 4;
+}
+
+Philox::counter_t Philox::block(counter_t counter, key_t key)
+{
+    for (int round = 0; round < PHILOX_ROUNDS; round++)
+    {
+        if (round > 0)
+        {
+            key[0] += PHILOX_W0;
+            key[1] += PHILOX_W1;
+        }
+
+        uint32_t hi0, lo0, hi1, lo1;
+        mulhilo(PHILOX_M0, counter[0], hi0, lo0);
+        mulhilo(PHILOX_M1, counter[2], hi1, lo1);
+        counter = {hi1 ^ counter[1] ^ key[0], lo1, hi0 ^ counter[3] ^ key[1],
+                   lo0};
+    }
+    return counter;
+}
+
+void Philox::refill()
+{
+    buffer_ = block(counter_, key_);
+    counter_[0]++;
+    index_ = 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef PHILOX_H_
+#define PHILOX_H_
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+/*
+ * Philox4x32-10 counter based generator (Salmon et al. 2011, "Parallel
+ * random numbers: as easy as 1, 2, 3"). The output is a bijection of a 128
+ * bit counter under a 64 bit key, so any number of independent streams can
+ * be opened in O(1) by choosing disjoint counters instead of seeding and
+ * advancing separate engines.
+ *
+ * The counter is laid out as (block, substream, stream low, stream high),
+ * giving 2^64 streams of 2^32 substreams of 2^34 draws each. Satisfies
+ * UniformRandomBitGenerator so it can drive the std distributions.
+ */
+class Philox
+{
+   public:
+    using result_type = uint32_t;
+    using counter_t = std::array<uint32_t, 4>;
+    using key_t = std::array<uint32_t, 2>;
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max()
+    {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    Philox() { seed(0, 0, 0); };
+    Philox(uint64_t key, uint64_t stream, uint32_t substream = 0)
+    {
+        seed(key, stream, substream);
+    };
+
+    // restart at the beginning of the given stream and substream
+    void seed(uint64_t key, uint64_t stream, uint32_t substream = 0);
+
+    result_type operator()()
+    {
+        if (index_ == 4)
+        {
+            refill();
+        }
+        return buffer_[index_++];
+    }
+
+    // one application of the bijection
+    static counter_t block(counter_t counter, key_t key);
+
+   private:
+    key_t key_{};
+    counter_t counter_{};
+    counter_t buffer_{};
+    int index_ = 4;
+
+    void refill();
+};
+
+#endif  // PHILOX_H_
@@ -1,48 +1,120 @@
 #include "prob_any_missing.h"
 
-#include <cmath>
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 
+namespace
+{
+double int_pow(double base, int exp)
+{
+    double res = 1.0;
+    while (exp > 0)
+    {
+        if (exp & 1)
+        {
+            res *= base;
+        }
+        base *= base;
+        exp >>= 1;
+    }
+    return res;
+}
+}  // namespace
+
 double probAnyMissingFunctor::operator()(const std::vector<double> &eventProbs,
                                          int numEvents)
 {
     int totalEvents = eventProbs.size();
-    int multCounter;
-    double r;
-    double prob = 0.0;
 
     if (numEvents < totalEvents)
     {
         return 1.0;
     }
 
-    // Calculate via inclusion-exclusion principle
-    int sign = -1;
-    for (int i = 1; i <= totalEvents; ++i)
+    return 1.0 - allDrawn(eventProbs, 1.0, numEvents);
+}
+
+double probAnyMissingFunctor::allDrawn(const std::vector<double> &eventProbs,
+                                       double totalProb, int numEvents)
+{
+    const int totalEvents = eventProbs.size();
+
+    if (numEvents < totalEvents)
     {
-        sign = -sign;
-        c.reset(totalEvents, i);
-        while (!c.completed)
+        return 0.0;
+    }
+
+    // Calculate via inclusion-exclusion principle over the subsets U of
+    // events that are never drawn, visited in Gray code order so that each
+    // subset differs from the last by a single event.
+    const uint64_t numSubsets = uint64_t{1} << totalEvents;
+    uint64_t subset = 0;
+    int sign = 1;
+    eventCombo = 0.0;
+
+    double prob = int_pow(totalProb, numEvents);
+    for (uint64_t g = 1; g < numSubsets; ++g)
+    {
+        // the bit flipped between gray(g - 1) and gray(g)
+        int k = 0;
+        while (!((g >> k) & 1))
         {
-            eventCombo = 0.0;
-            multCounter = numEvents;
+            ++k;
+        }
 
-            for (const auto &j : c.curr)
-            {
-                eventCombo += eventProbs[j];
-            }
+        subset ^= uint64_t{1} << k;
+        eventCombo += ((subset >> k) & 1) ? eventProbs[k] : -eventProbs[k];
+        sign = -sign;
+
+        prob += sign *
+                int_pow(std::max(totalProb - eventCombo, 0.0), numEvents);
+    }
+
+    return prob;
+}
+
+void probAnyMissingFunctor::allDrawn(const std::vector<double> &eventProbs,
+                                     double totalProb,
+                                     const std::vector<int> &numEvents,
+                                     std::vector<double> &res)
+{
+    const int totalEvents = eventProbs.size();
+    const size_t numCounts = numEvents.size();
+
+    res.resize(numCounts);
+    for (size_t c = 0; c < numCounts; ++c)
+    {
+        res[c] = numEvents[c] < totalEvents ? 0.0
+                                            : int_pow(totalProb, numEvents[c]);
+    }
 
-            r = sign;
+    // same walk as the single count version, so each count gets exactly the
+    // value it would alone
+    const uint64_t numSubsets = uint64_t{1} << totalEvents;
+    uint64_t subset = 0;
+    int sign = 1;
+    eventCombo = 0.0;
 
-            while (--multCounter >= 0)
+    for (uint64_t g = 1; g < numSubsets; ++g)
+    {
+        int k = 0;
+        while (!((g >> k) & 1))
+        {
+            ++k;
+        }
+
+        subset ^= uint64_t{1} << k;
+        eventCombo += ((subset >> k) & 1) ? eventProbs[k] : -eventProbs[k];
+        sign = -sign;
+
+        const double remaining = std::max(totalProb - eventCombo, 0.0);
+        for (size_t c = 0; c < numCounts; ++c)
+        {
+            if (numEvents[c] >= totalEvents)
             {
-                r *= (1 - eventCombo);
+                res[c] += sign * int_pow(remaining, numEvents[c]);
             }
-
-            prob += r;
-            c.next();
         }
     }
-
-    return prob;
 }
@@ -3,7 +3,7 @@
 #ifndef PROBANYMISSING_H
 #define PROBANYMISSING_H
 
-#include "combination_indices_generator.h"
+#include <vector>
 
 struct probAnyMissingFunctor
 {
@@ -11,8 +11,26 @@ struct probAnyMissingFunctor
 
     double operator()(const std::vector<double> &eventProbs, int numEvents);
 
+    /**
+     * Probability that numEvents draws all fall in a set of events and every
+     * event in the set is drawn at least once.
+     * @param eventProbs unnormalized probabilities of the events in the set
+     * @param totalProb sum of eventProbs
+     * @param numEvents number of draws
+     */
+    double allDrawn(const std::vector<double> &eventProbs, double totalProb,
+                    int numEvents);
+
+    /**
+     * allDrawn for several numbers of draws at once, sharing the walk over
+     * the subsets of events.
+     * @param numEvents numbers of draws
+     * @param res receives the probability for each of numEvents
+     */
+    void allDrawn(const std::vector<double> &eventProbs, double totalProb,
+                  const std::vector<int> &numEvents, std::vector<double> &res);
+
     double eventCombo{};
-    CombinationIndicesGenerator c;
 };
 
 #endif /* PROBANYMISSING_H */
@@ -0,0 +1,78 @@
+#include "profile.h"
+
+#include <algorithm>
+
+namespace
+{
+void add_counts(std::vector<long> &res, const std::vector<long> &other)
+{
+    res.resize(std::max(res.size(), other.size()), 0);
+    for (size_t k = 0; k < other.size(); k++)
+    {
+        res[k] += other[k];
+    }
+}
+
+void count(std::vector<long> &counts, int k)
+{
+    if ((int)counts.size() <= k)
+    {
+        counts.resize(k + 1, 0);
+    }
+    ++counts[k];
+}
+}  // namespace
+
+void Profile::Marginals::record(int coi, int num_alleles)
+{
+    count(by_coi, coi);
+    count(by_alleles, num_alleles);
+}
+
+void Profile::Marginals::merge(const Marginals &other)
+{
+    add_counts(by_coi, other.by_coi);
+    add_counts(by_alleles, other.by_alleles);
+}
+
+void Profile::Lookups::merge(const Lookups &other)
+{
+    lookups += other.lookups;
+    hits += other.hits;
+}
+
+void Profile::merge(const Profile &other)
+{
+    for (size_t k = 0; k < num_updates; k++)
+    {
+        update_calls[k] += other.update_calls[k];
+        update_seconds[k] += other.update_seconds[k];
+    }
+
+    enumeration.merge(other.enumeration);
+    dynamic_programming.merge(other.dynamic_programming);
+    importance_sampling.merge(other.importance_sampling);
+
+    marginal_cache.merge(other.marginal_cache);
+    pattern_memo.merge(other.pattern_memo);
+    latent_memo.merge(other.latent_memo);
+}
+
+ProfiledScope::ProfiledScope(Profile *profile, ProfiledUpdate update)
+    : profile_(profile), update_(static_cast<size_t>(update))
+{
+    if (profile_ != nullptr)
+    {
+        start_ = clock_t::now();
+    }
+}
+
+ProfiledScope::~ProfiledScope()
+{
+    if (profile_ != nullptr)
+    {
+        profile_->update_calls[update_] += 1;
+        profile_->update_seconds[update_] +=
+            std::chrono::duration<double>(clock_t::now() - start_).count();
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+// updates of a chain that are timed
+enum class ProfiledUpdate : size_t
+{
+    LatentGenotypes,
+    Coi,
+    MeanCoi,
+    AlleleFrequencies,
+    Eps,
+    EpsPos,
+    EpsNeg,
+    Individual
+};
+
+/*
+ * Counts of where a run spends its time, kept when run_mcmc is given
+ * profile = TRUE. Each chain counts its updates and each thread its
+ * marginals and lookups in its own Profile, summed once the run is over, so
+ * counting needs no synchronization.
+ */
+struct Profile
+{
+    static constexpr size_t num_updates = 8;
+
+    // marginals evaluated by a method, by COI and by number of alleles
+    struct Marginals
+    {
+        std::vector<long> by_coi{};
+        std::vector<long> by_alleles{};
+
+        void record(int coi, int num_alleles);
+        void merge(const Marginals &other);
+    };
+
+    // lookups in a cache or memo and how many found their value
+    struct Lookups
+    {
+        long lookups = 0;
+        long hits = 0;
+
+        void record(bool hit)
+        {
+            ++lookups;
+            hits += hit;
+        }
+        void merge(const Lookups &other);
+    };
+
+    // by ProfiledUpdate
+    std::array<long, num_updates> update_calls{};
+    std::array<double, num_updates> update_seconds{};
+
+    Marginals enumeration{};
+    Marginals dynamic_programming{};
+    Marginals importance_sampling{};
+
+    // exact marginals found in the MarginalCache
+    Lookups marginal_cache{};
+    // marginals of repeated observed genotypes in allele frequency updates
+    Lookups pattern_memo{};
+    // importance weights of repeated latent genotypes
+    Lookups latent_memo{};
+
+    void merge(const Profile &other);
+};
+
+// adds the wall time of its scope to an update's totals in profile, doing
+// nothing if profile is null
+class ProfiledScope
+{
+   public:
+    ProfiledScope(Profile *profile, ProfiledUpdate update);
+    ~ProfiledScope();
+
+    ProfiledScope(const ProfiledScope &) = delete;
+    ProfiledScope &operator=(const ProfiledScope &) = delete;
+
+   private:
+    using clock_t = std::chrono::steady_clock;
+
+    Profile *profile_;
+    size_t update_;
+    clock_t::time_point start_{};
+};
+
+#endif  // PROFILE_H_
@@ -0,0 +1,106 @@
+#include "revolving_door_generator.h"
+
+RevolvingDoorGenerator::RevolvingDoorGenerator(int n, int r) { reset(n, r); }
+
+RevolvingDoorGenerator::RevolvingDoorGenerator()
+{
+    completed = true;
+    n_ = 0;
+    r_ = 0;
+}
+
+void RevolvingDoorGenerator::reset(int n, int r)
+{
+    completed = n < 1 or r > n or r == 0;
+    generated = 1;
+    removed = -1;
+    added = -1;
+
+    n_ = n;
+    r_ = r;
+
+    c_.resize(r_ + 2);
+    for (int j = 1; j <= r_; j++)
+    {
+        c_[j] = j - 1;
+    }
+    c_[r_ + 1] = n_;
+
+    curr.resize(r_);
+    sync_curr_();
+}
+
+void RevolvingDoorGenerator::next() noexcept
+{
+    if (completed)
+    {
+        return;
+    }
+
+    // R3, easy cases only move c_1
+    if (r_ % 2 == 1)
+    {
+        if (c_[1] + 1 < c_[2])
+        {
+            removed = c_[1];
+            added = ++c_[1];
+            curr[0] = added;
+            generated++;
+            return;
+        }
+    }
+    else if (c_[1] > 0)
+    {
+        removed = c_[1];
+        added = --c_[1];
+        curr[0] = added;
+        generated++;
+        return;
+    }
+
+    int j = 2;
+    bool decrease = r_ % 2 == 1;
+    while (j <= r_)
+    {
+        if (decrease)
+        {
+            // R4, here c_j = c_{j-1} + 1
+            if (c_[j] >= j)
+            {
+                removed = c_[j];
+                added = j - 2;
+                c_[j] = c_[j - 1];
+                c_[j - 1] = j - 2;
+                sync_curr_();
+                generated++;
+                return;
+            }
+        }
+        else
+        {
+            // R5, here c_{j-1} = j - 2
+            if (c_[j] + 1 < c_[j + 1])
+            {
+                removed = j - 2;
+                added = c_[j] + 1;
+                c_[j - 1] = c_[j];
+                c_[j] = added;
+                sync_curr_();
+                generated++;
+                return;
+            }
+        }
+        j++;
+        decrease = !decrease;
+    }
+
+    completed = true;
+}
+
+void RevolvingDoorGenerator::sync_curr_() noexcept
+{
+    for (int j = 1; j <= r_; j++)
+    {
+        curr[j - 1] = c_[j];
+    }
+}
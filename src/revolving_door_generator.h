@@ -0,0 +1,46 @@
+#ifndef REVOLVINGDOORGENERATOR_H
+#define REVOLVINGDOORGENERATOR_H
+
+#include <vector>
+
+// Knuth, TAOCP Vol. 4A, 7.2.1.3 Algorithm R
+struct RevolvingDoorGenerator
+{
+    using combination_t = std::vector<int>;
+
+    bool completed;
+    unsigned long generated = 1;
+
+    /**
+     * Generate the n choose r element combinations in revolving door order,
+     * each combination differs from the previous one by exactly one element
+     * leaving and one element entering.
+     * @param n number of elements
+     * @param r number of choices
+     */
+    RevolvingDoorGenerator(int n, int r);
+
+    RevolvingDoorGenerator();
+
+    void reset(int n, int r);
+
+    void next() noexcept;
+
+    // current combination in increasing order
+    combination_t curr{};
+
+    // element that left and element that entered on the last call to next()
+    int removed = -1;
+    int added = -1;
+
+   private:
+    int n_;
+    int r_;
+
+    // Knuth's c_1..c_{r+1}, c_{r+1} = n is a sentinel
+    std::vector<int> c_{};
+
+    void sync_curr_() noexcept;
+};
+
+#endif /* REVOLVINGDOORGENERATOR_H */
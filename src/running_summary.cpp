@@ -0,0 +1,147 @@
+#include "running_summary.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+P2Quantile::P2Quantile(double prob) : prob_(prob)
+{
+    desired_ = {1, 1 + 2 * prob, 1 + 4 * prob, 3 + 2 * prob, 5};
+    increments_ = {0, prob / 2, prob, (1 + prob) / 2, 1};
+}
+
+void P2Quantile::add(double x)
+{
+    if (count_ < 5)
+    {
+        heights_[count_++] = x;
+        if (count_ == 5)
+        {
+            std::sort(heights_.begin(), heights_.end());
+            positions_ = {1, 2, 3, 4, 5};
+        }
+        return;
+    }
+    count_++;
+
+    // cell holding x, stretching the extreme markers if it is outside them
+    int k;
+    if (x < heights_[0])
+    {
+        heights_[0] = x;
+        k = 0;
+    }
+    else if (x >= heights_[4])
+    {
+        heights_[4] = x;
+        k = 3;
+    }
+    else
+    {
+        k = 0;
+        while (x >= heights_[k + 1])
+        {
+            k++;
+        }
+    }
+
+    for (int i = k + 1; i < 5; i++)
+    {
+        positions_[i]++;
+    }
+    for (int i = 0; i < 5; i++)
+    {
+        desired_[i] += increments_[i];
+    }
+
+    // move the middle markers at most one position towards where they
+    // should be
+    for (int i = 1; i < 4; i++)
+    {
+        const double d = desired_[i] - positions_[i];
+        if ((d >= 1 && positions_[i + 1] - positions_[i] > 1) ||
+            (d <= -1 && positions_[i - 1] - positions_[i] < -1))
+        {
+            const double step = d > 0 ? 1 : -1;
+            const double height = parabolic(i, step);
+            if (heights_[i - 1] < height && height < heights_[i + 1])
+            {
+                heights_[i] = height;
+            }
+            else
+            {
+                heights_[i] = linear(i, step);
+            }
+            positions_[i] += step;
+        }
+    }
+}
+
+double P2Quantile::parabolic(int k, double d) const
+{
+    const double below = positions_[k] - positions_[k - 1];
+    const double above = positions_[k + 1] - positions_[k];
+    return heights_[k] +
+           d / (positions_[k + 1] - positions_[k - 1]) *
+               ((below + d) * (heights_[k + 1] - heights_[k]) / above +
+                (above - d) * (heights_[k] - heights_[k - 1]) / below);
+}
+
+double P2Quantile::linear(int k, double d) const
+{
+    const int neighbour = k + (int)d;
+    return heights_[k] + d * (heights_[neighbour] - heights_[k]) /
+                             (positions_[neighbour] - positions_[k]);
+}
+
+double P2Quantile::value() const
+{
+    if (count_ == 0)
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    if (count_ >= 5)
+    {
+        return heights_[2];
+    }
+
+    // too few values for the markers, interpolate the order statistics as
+    // R's default quantile() does
+    std::array<double, 5> sorted = heights_;
+    std::sort(sorted.begin(), sorted.begin() + count_);
+    const double h = (count_ - 1) * prob_;
+    const size_t lo = (size_t)std::floor(h);
+    const size_t hi = std::min(lo + 1, count_ - 1);
+    return sorted[lo] + (h - lo) * (sorted[hi] - sorted[lo]);
+}
+
+RunningSummary::RunningSummary(const std::vector<double> &probs)
+{
+    quantiles_.reserve(probs.size());
+    for (const double prob : probs)
+    {
+        quantiles_.emplace_back(prob);
+    }
+}
+
+void RunningSummary::add(double x)
+{
+    count_++;
+    const double delta = x - mean_;
+    mean_ += delta / count_;
+    m2_ += delta * (x - mean_);
+
+    for (auto &quantile : quantiles_)
+    {
+        quantile.add(x);
+    }
+}
+
+double RunningSummary::variance() const
+{
+    if (count_ < 2)
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return m2_ / (count_ - 1);
+}
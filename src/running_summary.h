@@ -0,0 +1,63 @@
+#pragma once
+
+#ifndef RUNNING_SUMMARY_H_
+#define RUNNING_SUMMARY_H_
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+/*
+ * P-squared estimate of one quantile of a stream (Jain and Chlamtac, 1985).
+ * Five markers track the minimum, the maximum, the quantile and the
+ * quantiles halfway to either end, and are moved by piecewise parabolic
+ * interpolation as values arrive, so memory is constant. The first five
+ * values are kept and their quantile is exact.
+ */
+class P2Quantile
+{
+   public:
+    P2Quantile(double prob);
+
+    void add(double x);
+    double value() const;
+
+   private:
+    double prob_;
+    size_t count_ = 0;
+    std::array<double, 5> heights_{};
+    std::array<double, 5> positions_{};
+    std::array<double, 5> desired_{};
+    std::array<double, 5> increments_{};
+
+    double parabolic(int k, double d) const;
+    double linear(int k, double d) const;
+};
+
+/*
+ * Streaming mean and variance (Welford) together with P-squared estimates of
+ * a fixed set of quantiles of one scalar quantity.
+ */
+class RunningSummary
+{
+   public:
+    RunningSummary(const std::vector<double> &probs);
+
+    void add(double x);
+
+    size_t count() const { return count_; };
+    double mean() const { return mean_; };
+    // sample variance, NaN with fewer than two values
+    double variance() const;
+    // estimate of the k'th of the probabilities given at construction
+    double quantile(size_t k) const { return quantiles_[k].value(); };
+    size_t num_quantiles() const { return quantiles_.size(); };
+
+   private:
+    size_t count_ = 0;
+    double mean_ = 0;
+    double m2_ = 0;
+    std::vector<P2Quantile> quantiles_{};
+};
+
+#endif  // RUNNING_SUMMARY_H_
@@ -3,40 +3,85 @@
 
 #include "mcmc_utils.h"
 
-#include <Rcpp.h>
-#include <Rmath.h>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <random>
 
-std::random_device Sampler::rd;
-
-Sampler::Sampler(Lookup lookup) : lookup(lookup)
+Sampler::Sampler(const Lookup &lookup) : lookup(lookup)
 {
-    eng = std::ranlux24_base(rd());
-    gsl_rd = gsl_rng_alloc(gsl_rng_minstd);
     unif_distr = std::uniform_real_distribution<double>(0, 1);
     ber_distr = std::bernoulli_distribution(.5);
 }
 
-double Sampler::dbeta(double x, double alpha, double beta, bool return_log)
+// the densities are evaluated from ThreadPool jobs, so they are computed in
+// closed form rather than through Rmath, and take their log normalizers
+// precomputed as neither Rmath nor std::lgamma is thread safe
+namespace
+{
+constexpr double neg_inf = -std::numeric_limits<double>::infinity();
+
+double density(double log_density, bool return_log)
+{
+    return return_log ? log_density : std::exp(log_density);
+}
+
+// (a - 1) log(x), taking the a == 1 term as 0 at x == 0
+double log_power(double x, double a)
 {
-    return R::dbeta(x, alpha, beta, return_log);
+    return a == 1 ? 0 : (a - 1) * std::log(x);
+}
+}  // namespace
+
+double Sampler::dbeta(double x, double alpha, double beta, double log_beta,
+                      bool return_log)
+{
+    if (x < 0 || x > 1)
+    {
+        return density(neg_inf, return_log);
+    }
+    return density(
+        log_power(x, alpha) + log_power(1 - x, beta) - log_beta, return_log);
 }
 
 double Sampler::dpois(int x, double mean, bool return_log)
 {
-    return R::dpois(x, mean, return_log);
+    if (x < 0)
+    {
+        return density(neg_inf, return_log);
+    }
+    if (mean == 0)
+    {
+        return density(x == 0 ? 0 : neg_inf, return_log);
+    }
+    return density(x * std::log(mean) - mean - lookup.log_factorial(x),
+                   return_log);
 }
 
+// the mean changes once per mean COI update while every sample's COI is
+// scored against it, so the terms of the mean are kept between calls
 double Sampler::dztpois(int x, double lambda)
 {
-    return x * std::log(lambda) - std::log(std::exp(lambda) - 1) -
-           lookup.lookup_lgamma[x + 1];
+    if (lambda != ztpois_mean_)
+    {
+        ztpois_mean_ = lambda;
+        ztpois_log_mean_ = std::log(lambda);
+        ztpois_log_norm_ = std::log(std::expm1(lambda));
+    }
+    return x * ztpois_log_mean_ - ztpois_log_norm_ - lookup.log_factorial(x);
 }
 
-double Sampler::dgamma(double x, double shape, double scale, bool return_log)
+double Sampler::dgamma(double x, double shape, double scale,
+                       double log_gamma_shape, bool return_log)
 {
-    return R::dgamma(x, shape, scale, return_log);
+    if (x < 0)
+    {
+        return density(neg_inf, return_log);
+    }
+    return density(log_power(x, shape) - x / scale - log_gamma_shape -
+                       shape * std::log(scale),
+                   return_log);
 }
 
 double Sampler::rgamma(double alpha, double beta)
@@ -56,11 +101,6 @@ double Sampler::rgamma(double alpha, double beta)
     return x;
 };
 
-double Sampler::rgamma2(double shape, double rate)
-{
-    return R::rgamma(shape, 1 / rate);
-}
-
 std::vector<double> Sampler::rdirichlet(std::vector<double> const &shape_vec)
 {
     int n = shape_vec.size();
@@ -109,11 +149,6 @@ std::vector<double> Sampler::rlogit_norm(std::vector<double> const &p,
     return ret;
 }
 
-double Sampler::sample_mean_coi(double mean_shape, double mean_rate)
-{
-    return rgamma2(mean_shape, mean_rate) + 1;
-}
-
 int Sampler::sample_random_int(int lower, int upper)
 {
     unif_int_distr.param(
@@ -126,9 +161,10 @@ double Sampler::get_coi_log_prob(int coi, double mean)
     return dztpois(coi, mean);
 }
 
-double Sampler::get_coi_mean_log_prior(double mean, double shape, double scale)
+double Sampler::get_coi_mean_log_prior(double mean, double shape, double scale,
+                                       double log_gamma_shape)
 {
-    return dgamma(mean, shape, scale, true);
+    return dgamma(mean, shape, scale, log_gamma_shape, true);
 }
 
 int Sampler::sample_coi_delta() { return (2 * ber_distr(eng) - 1); }
@@ -141,9 +177,10 @@ int Sampler::sample_coi_delta(double coi_prop_mean)
     return (2 * ber_distr(eng) - 1) * (geom_distr(eng));
 }
 
-double Sampler::get_epsilon_log_prior(double x, double alpha, double beta)
+double Sampler::get_epsilon_log_prior(double x, double alpha, double beta,
+                                      double log_beta)
 {
-    return dbeta(x, alpha, beta, true);
+    return dbeta(x, alpha, beta, log_beta, true);
 }
 
 // double Sampler::sample_epsilon(double curr_epsilon, double variance) {
@@ -160,6 +197,25 @@ double Sampler::sample_epsilon(double curr_epsilon, double variance)
     return prop;
 };
 
+// inverse CDF of the truncated distribution
+double Sampler::sample_truncated_beta(double alpha, double beta, double upper)
+{
+    const boost::math::beta_distribution<> dist(alpha, beta);
+    const double upper_mass = boost::math::cdf(dist, upper);
+    if (!(upper_mass > 0))
+    {
+        // all the mass is above upper
+        return std::nextafter(upper, 0.0);
+    }
+
+    double res = 0;
+    while (res <= 0 || res >= upper)
+    {
+        res = boost::math::quantile(dist, unif_distr(eng) * upper_mass);
+    }
+    return res;
+}
+
 double Sampler::sample_epsilon_pos(double curr_epsilon_pos, double variance)
 {
     return sample_epsilon(curr_epsilon_pos, variance);
@@ -189,25 +245,135 @@ std::vector<double> Sampler::sample_allele_frequencies2(
     return rlogit_norm(curr_allele_frequencies, variance);
 };
 
+// coi categorical draws by inversion of the cumulative frequencies, returning
+// the distinct alleles drawn in increasing order
 std::vector<int> Sampler::sample_latent_genotype(
     int coi, const std::vector<double> &allele_frequencies)
 {
-    std::vector<int> tmp_alleles(allele_frequencies.size(), 0);
     std::vector<int> allele_index_vec{};
-    allele_index_vec.reserve(coi);
+    sample_latent_genotype(coi, allele_frequencies, allele_index_vec);
+    return allele_index_vec;
+}
+
+void Sampler::sample_latent_genotype(
+    int coi, const std::vector<double> &allele_frequencies,
+    std::vector<int> &allele_index_vec)
+{
+    set_latent_allele_frequencies(allele_frequencies);
+    sample_latent_genotype(coi, allele_index_vec);
+}
+
+void Sampler::sample_latent_genotype(
+    int coi, const std::vector<double> &allele_frequencies,
+    const double *uniforms, std::vector<int> &allele_index_vec)
+{
+    set_latent_allele_frequencies(allele_frequencies);
+    sample_latent_genotype(coi, uniforms, allele_index_vec);
+}
 
-    gsl_ran_multinomial(gsl_rd, allele_frequencies.size(), coi,
-                        allele_frequencies.data(),
-                        (unsigned int *)tmp_alleles.data());
+void Sampler::set_latent_allele_frequencies(
+    const std::vector<double> &allele_frequencies)
+{
+    const size_t total_alleles = allele_frequencies.size();
+    cumulative_freqs_.resize(total_alleles);
 
-    for (size_t i = 0; i < allele_frequencies.size(); i++)
+    double total = 0;
+    for (size_t i = 0; i < total_alleles; i++)
     {
-        if (tmp_alleles[i] > 0)
-        {
-            allele_index_vec.push_back(i);
-        }
+        total += allele_frequencies[i];
+        cumulative_freqs_[i] = total;
     }
-    return allele_index_vec;
+}
+
+void Sampler::sample_latent_genotype(int coi,
+                                     std::vector<int> &allele_index_vec)
+{
+    uniforms_.resize(coi);
+    for (auto &u : uniforms_)
+    {
+        u = unif_distr(eng);
+    }
+    sample_latent_genotype(coi, uniforms_.data(), allele_index_vec);
+}
+
+void Sampler::sample_latent_genotype(int coi, const double *uniforms,
+                                     std::vector<int> &allele_index_vec)
+{
+    const size_t total_alleles = cumulative_freqs_.size();
+    const double total = cumulative_freqs_.back();
+
+    // collect the drawn alleles and drop repeats, never touching the alleles
+    // that were not drawn
+    allele_index_vec.clear();
+    for (int draw = 0; draw < coi; draw++)
+    {
+        const double u = uniforms[draw] * total;
+        const size_t allele =
+            std::upper_bound(cumulative_freqs_.begin(),
+                             cumulative_freqs_.end(), u) -
+            cumulative_freqs_.begin();
+        allele_index_vec.push_back(std::min(allele, total_alleles - 1));
+    }
+    std::sort(allele_index_vec.begin(), allele_index_vec.end());
+    allele_index_vec.erase(
+        std::unique(allele_index_vec.begin(), allele_index_vec.end()),
+        allele_index_vec.end());
+}
+
+void Sampler::sample_latent_counts(int coi, std::vector<int> &counts)
+{
+    const size_t total_alleles = cumulative_freqs_.size();
+    const double total = cumulative_freqs_.back();
+
+    counts.assign(total_alleles, 0);
+    for (int draw = 0; draw < coi; draw++)
+    {
+        const double u = unif_distr(eng) * total;
+        const size_t allele =
+            std::upper_bound(cumulative_freqs_.begin(),
+                             cumulative_freqs_.end(), u) -
+            cumulative_freqs_.begin();
+        ++counts[std::min(allele, total_alleles - 1)];
+    }
+}
+
+// inversion, walking up the CDF from 1 with the mass at 0 removed
+int Sampler::sample_ztpois(double mean)
+{
+    const double u = unif_distr(eng) * -std::expm1(-mean);
+    double pmf = std::exp(-mean) * mean;
+    double cdf = pmf;
+    int res = 1;
+    while (cdf < u && pmf > 0)
+    {
+        ++res;
+        pmf *= mean / res;
+        cdf += pmf;
+    }
+    return res;
 }
 
 double Sampler::sample_log_mh_acceptance() { return log(unif_distr(eng)); };
+
+double Sampler::runif_0_1() { return unif_distr(eng); };
+
+void Sampler::seed(uint64_t seed, uint64_t stream, uint32_t substream)
+{
+    eng.seed(seed, stream, substream);
+
+    unif_int_distr.reset();
+    norm_distr.reset();
+    gamma_distr.reset();
+    discrete_distr.reset();
+    unif_distr.reset();
+    ber_distr.reset();
+    geom_distr.reset();
+}
+
+// family in the top 8 bits, chain in the next 16, index in the low 40
+uint64_t Sampler::stream_id(RandomStream family, uint64_t chain,
+                            uint64_t index)
+{
+    return ((uint64_t)family << 56) | ((chain & 0xFFFF) << 40) |
+           (index & 0xFFFFFFFFFF);
+}
@@ -2,14 +2,29 @@
 #define SAMPLER_H_
 
 #include "lookup.h"
+#include "philox.h"
 
-#include <RcppGSL.h>
-
-#include <boost/random.hpp>
-#include <gsl/gsl_randist.h>
-
+#include <cstdint>
 #include <random>
 
+// Independent families of random number streams, see Sampler::stream_id
+enum class RandomStream : uint64_t
+{
+    Chain,            // chain level updates
+    Initialize,       // initial likelihood, per sample
+    AlleleFrequency,  // allele frequency updates, per locus
+    Coi,              // COI updates, per sample
+    EpsPos,           // false positive rate updates, per sample
+    EpsNeg,           // false negative rate updates, per sample
+    Eps,              // joint error rate updates, per sample
+    Individual,       // joint sample parameter updates, per sample
+    Swap,             // tempering swaps, per run
+    MeanCoi,          // mean COI updates, per chain
+    Latent,           // latent genotype updates, per sample
+    SimulatedCoi,     // COIs of simulated data, per run
+    SimulatedLocus    // simulated allele frequencies and genotypes, per locus
+};
+
 class Sampler
 {
    private:
@@ -21,36 +36,47 @@ class Sampler
     std::bernoulli_distribution ber_distr;
     std::geometric_distribution<int> geom_distr;
 
-    double dbeta(double x, double alpha, double beta, bool return_log);
+    double dbeta(double x, double alpha, double beta, double log_beta,
+                 bool return_log);
     double dpois(int x, double mean, bool return_log);
     double dztpois(int x, double mean);
-    double dgamma(double x, double shape, double scale, bool return_log);
+    double dgamma(double x, double shape, double scale,
+                  double log_gamma_shape, bool return_log);
     double rgamma(double alpha, double beta);
-    double rgamma2(double shape, double rate);
 
     std::vector<double> rdirichlet(std::vector<double> const &shape_vec);
     std::vector<double> rlogit_norm(std::vector<double> const &p,
                                     double variance);
-    Lookup lookup;
+    const Lookup &lookup;
+
+    // terms of dztpois that only depend on the mean, for the mean last seen
+    double ztpois_mean_ = -1;
+    double ztpois_log_mean_ = 0;
+    double ztpois_log_norm_ = 0;
+
+    // cumulative allele frequencies used by sample_latent_genotype
+    std::vector<double> cumulative_freqs_{};
+    std::vector<double> uniforms_{};
 
    public:
-    static std::random_device rd;
-    std::ranlux24_base eng;
-    gsl_rng *gsl_rd;
-    boost::random::mt19937 r;
+    Philox eng;
 
-    double get_epsilon_log_prior(double x, double alpha, double beta);
+    // the log normalizers are computed once by Parameters, see there
+    double get_epsilon_log_prior(double x, double alpha, double beta,
+                                 double log_beta);
     double get_coi_log_prob(int coi, double mean);
-    double get_coi_mean_log_prior(double mean, double shape, double scale);
+    double get_coi_mean_log_prior(double mean, double shape, double scale,
+                                  double log_gamma_shape);
 
     double sample_epsilon(double curr_epsilon, double variance);
     double sample_epsilon_pos(double curr_epsilon_pos, double variance);
     double sample_epsilon_neg(double curr_epsilon_neg, double variance);
+    // draw from Beta(alpha, beta) truncated to (0, upper)
+    double sample_truncated_beta(double alpha, double beta, double upper);
 
     int sample_coi(int curr_coi, int delta, int max_coi);
     int sample_coi_delta(double coi_prop_mean);
     int sample_coi_delta();
-    double sample_mean_coi(double coi_mean_shape, double coi_mean_rate);
 
     int sample_random_int(int lower, int upper);
     std::vector<double> sample_allele_frequencies(
@@ -63,11 +89,54 @@ class Sampler
 
     std::vector<int> sample_latent_genotype(
         int coi, const std::vector<double> &allele_frequencies);
+    void sample_latent_genotype(int coi,
+                                const std::vector<double> &allele_frequencies,
+                                std::vector<int> &allele_index_vec);
+    // as above from caller supplied uniforms, one per draw
+    void sample_latent_genotype(int coi,
+                                const std::vector<double> &allele_frequencies,
+                                const double *uniforms,
+                                std::vector<int> &allele_index_vec);
+
+    /**
+     * Prepare repeated latent genotype draws from the same allele
+     * frequencies, so each draw costs O(coi log alleles) rather than a pass
+     * over every allele.
+     */
+    void set_latent_allele_frequencies(
+        const std::vector<double> &allele_frequencies);
+    // as above from the frequencies last set
+    void sample_latent_genotype(int coi, std::vector<int> &allele_index_vec);
+    void sample_latent_genotype(int coi, const double *uniforms,
+                                std::vector<int> &allele_index_vec);
+    // number of the coi strains carrying each allele, a multinomial draw
+    // from the frequencies last set
+    void sample_latent_counts(int coi, std::vector<int> &counts);
+
+    // zero truncated Poisson, as the prior on COI
+    int sample_ztpois(double mean);
 
     double sample_log_mh_acceptance();
     double runif_0_1();
 
-    Sampler(Lookup lookup);
+    /**
+     * Restart the sampler at the beginning of a substream of the run's
+     * seed, discarding any state cached by the distributions. Streams from
+     * different ids or substreams never overlap.
+     * @param seed seed of the run
+     * @param stream id from stream_id
+     * @param substream e.g. the iteration
+     */
+    void seed(uint64_t seed, uint64_t stream, uint32_t substream = 0);
+
+    /**
+     * Stream id of the index'th item, e.g. a locus or sample, in a family
+     * of streams of a chain.
+     */
+    static uint64_t stream_id(RandomStream family, uint64_t chain,
+                              uint64_t index = 0);
+
+    explicit Sampler(const Lookup &lookup);
 };
 
 #endif  // SAMPLER_H_
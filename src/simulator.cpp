@@ -0,0 +1,65 @@
+#include "simulator.h"
+
+#include "lookup.h"
+#include "sampler.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+
+SimulatedData simulate_genotyping_data(
+    double mean_coi, const std::vector<std::vector<double>> &locus_freq_alphas,
+    int num_samples, double epsilon_pos, double epsilon_neg, uint64_t seed,
+    int num_threads)
+{
+    const size_t num_loci = locus_freq_alphas.size();
+    int max_alleles = 0;
+    for (const auto &alphas : locus_freq_alphas)
+    {
+        max_alleles = std::max(max_alleles, (int)alphas.size());
+    }
+    const Lookup lookup(max_alleles);
+
+    SimulatedData res;
+    res.allele_freqs.resize(num_loci);
+    res.true_genotypes.resize(num_loci);
+    res.observed.resize(num_loci);
+
+    Sampler sampler(lookup);
+    sampler.seed(seed, Sampler::stream_id(RandomStream::SimulatedCoi, 0));
+    res.sample_cois.resize(num_samples);
+    for (auto &coi : res.sample_cois)
+    {
+        coi = sampler.sample_ztpois(mean_coi);
+    }
+
+    ThreadPool pool(num_threads);
+    std::vector<Sampler> samplers(pool.size(), sampler);
+    pool.parallel_for(num_loci, [&](size_t j, int t) {
+        Sampler &locus_sampler = samplers[t];
+        locus_sampler.seed(
+            seed, Sampler::stream_id(RandomStream::SimulatedLocus, 0, j));
+
+        res.allele_freqs[j] =
+            locus_sampler.sample_allele_frequencies(locus_freq_alphas[j], 1);
+        locus_sampler.set_latent_allele_frequencies(res.allele_freqs[j]);
+
+        auto &true_genotypes = res.true_genotypes[j];
+        auto &observed = res.observed[j];
+        true_genotypes.resize(num_samples);
+        observed.resize(num_samples);
+        for (int i = 0; i < num_samples; i++)
+        {
+            locus_sampler.sample_latent_counts(res.sample_cois[i],
+                                               true_genotypes[i]);
+            observed[i].resize(true_genotypes[i].size());
+            for (size_t k = 0; k < observed[i].size(); k++)
+            {
+                const double u = locus_sampler.runif_0_1();
+                observed[i][k] = true_genotypes[i][k] > 0 ? u >= epsilon_neg
+                                                          : u < epsilon_pos;
+            }
+        }
+    });
+
+    return res;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef SIMULATOR_H_
+#define SIMULATOR_H_
+
+#include <cstdint>
+#include <vector>
+
+// data simulated from the model
+struct SimulatedData
+{
+    // by locus
+    std::vector<std::vector<double>> allele_freqs{};
+    // by sample
+    std::vector<int> sample_cois{};
+    // by locus, then sample, then allele, the strains of the sample carrying
+    // each allele
+    std::vector<std::vector<std::vector<int>>> true_genotypes{};
+    // by locus, then sample, then allele, 1 if the allele was observed, the
+    // layout GenotypingData is built from
+    std::vector<std::vector<std::vector<int>>> observed{};
+};
+
+/*
+ * Simulates num_samples samples at one locus per element of
+ * locus_freq_alphas. Allele frequencies are drawn from Dirichlet
+ * distributions, COIs from a zero truncated Poisson, latent genotypes as
+ * multinomial draws of each sample's strains, and every allele's presence
+ * is flipped with probability epsilon_neg and its absence with probability
+ * epsilon_pos. Loci are simulated in parallel on num_threads threads, each
+ * from its own random number stream, so the data only depends on the seed.
+ */
+SimulatedData simulate_genotyping_data(
+    double mean_coi, const std::vector<std::vector<double>> &locus_freq_alphas,
+    int num_samples, double epsilon_pos, double epsilon_neg, uint64_t seed,
+    int num_threads);
+
+#endif  // SIMULATOR_H_
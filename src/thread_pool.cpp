@@ -0,0 +1,168 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads_(num_threads < 1 ? 1 : num_threads)
+{
+    workers_.reserve(num_threads_ - 1);
+    for (int i = 1; i < num_threads_; i++)
+    {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto &worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(const std::function<void(int)> &fn)
+{
+    run(fn, nullptr, std::chrono::milliseconds(0));
+}
+
+void ThreadPool::run(const std::function<void(int)> &fn,
+                     const std::function<void()> &idle,
+                     std::chrono::milliseconds idle_period)
+{
+    if (num_threads_ == 1)
+    {
+        fn(0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = &fn;
+        error_ = nullptr;
+        pending_ = num_threads_ - 1;
+        ++generation_;
+    }
+    start_cv_.notify_all();
+
+    std::exception_ptr local_error = nullptr;
+    try
+    {
+        fn(0);
+    }
+    catch (...)
+    {
+        local_error = std::current_exception();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto done = [this] { return pending_ == 0; };
+    if (idle)
+    {
+        while (!done_cv_.wait_for(lock, idle_period, done))
+        {
+            lock.unlock();
+            try
+            {
+                idle();
+            }
+            catch (...)
+            {
+                if (!local_error)
+                {
+                    local_error = std::current_exception();
+                }
+            }
+            lock.lock();
+        }
+    }
+    else
+    {
+        done_cv_.wait(lock, done);
+    }
+    job_ = nullptr;
+
+    if (local_error)
+    {
+        std::rethrow_exception(local_error);
+    }
+    if (error_)
+    {
+        std::rethrow_exception(error_);
+    }
+}
+
+int ThreadPool::hardware_threads()
+{
+    const unsigned int n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+bool ThreadPool::next_index(std::vector<WorkRange> &ranges, int thread_id,
+                            size_t &index)
+{
+    {
+        WorkRange &own = ranges[thread_id];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.begin < own.end)
+        {
+            index = own.begin++;
+            return true;
+        }
+    }
+
+    const int num_ranges = ranges.size();
+    for (int offset = 1; offset < num_ranges; offset++)
+    {
+        WorkRange &victim = ranges[(thread_id + offset) % num_ranges];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.begin < victim.end)
+        {
+            index = --victim.end;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::worker_loop(int thread_id)
+{
+    unsigned long seen = 0;
+    while (true)
+    {
+        const std::function<void(int)> *job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_cv_.wait(lock,
+                           [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+            {
+                return;
+            }
+            seen = generation_;
+            job = job_;
+        }
+
+        try
+        {
+            (*job)(thread_id);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_)
+            {
+                error_ = std::current_exception();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0)
+        {
+            done_cv_.notify_one();
+        }
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed size pool of worker threads. The calling thread participates in
+ * every job as thread 0, so a pool of size 1 spawns no threads and runs
+ * everything inline.
+ *
+ * Jobs must not call into the R API, only thread 0 may do so and only when
+ * the pool is driven from the main R thread.
+ */
+class ThreadPool
+{
+   public:
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int size() const { return num_threads_; }
+
+    // number of threads the machine can run concurrently, at least 1
+    static int hardware_threads();
+
+    /**
+     * Run fn(thread_id) once on every thread and block until all of them
+     * have returned. The first exception thrown by any thread is rethrown
+     * here.
+     */
+    void run(const std::function<void(int)> &fn);
+
+    /**
+     * As run, and once thread 0 has returned from fn, call idle() on it
+     * every idle_period until the other threads are done, e.g. to keep
+     * polling R for interrupts. An exception thrown by idle is rethrown
+     * once every thread has returned.
+     */
+    void run(const std::function<void(int)> &fn,
+             const std::function<void()> &idle,
+             std::chrono::milliseconds idle_period);
+
+    /**
+     * Call fn(i, thread_id) for every i in [0, n). The range is split into
+     * size() contiguous blocks, so the assignment of indices to threads only
+     * depends on n and the pool size.
+     */
+    template <class F>
+    void parallel_for(size_t n, F fn)
+    {
+        run([&](int thread_id) {
+            const size_t begin = n * thread_id / num_threads_;
+            const size_t end = n * (thread_id + 1) / num_threads_;
+            for (size_t i = begin; i < end; i++)
+            {
+                fn(i, thread_id);
+            }
+        });
+    }
+
+    /**
+     * Call fn(i, thread_id) for every i in [0, n), balancing uneven work.
+     * Each thread starts on the same contiguous block as parallel_for and,
+     * once it is exhausted, steals indices from the end of the other
+     * threads' blocks. The assignment of indices to threads is not
+     * deterministic.
+     */
+    template <class F>
+    void parallel_for_dynamic(size_t n, F fn)
+    {
+        parallel_for_dynamic(n, fn, nullptr, std::chrono::milliseconds(0));
+    }
+
+    // as above, calling idle on thread 0 as in run once it runs out of work
+    template <class F>
+    void parallel_for_dynamic(size_t n, F fn,
+                              const std::function<void()> &idle,
+                              std::chrono::milliseconds idle_period)
+    {
+        std::vector<WorkRange> ranges(num_threads_);
+        for (int t = 0; t < num_threads_; t++)
+        {
+            ranges[t].begin = n * t / num_threads_;
+            ranges[t].end = n * (t + 1) / num_threads_;
+        }
+
+        run(
+            [&](int thread_id) {
+                size_t i;
+                while (next_index(ranges, thread_id, i))
+                {
+                    fn(i, thread_id);
+                }
+            },
+            idle, idle_period);
+    }
+
+   private:
+    struct WorkRange
+    {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    // take the next index from the thread's own range, else steal one
+    static bool next_index(std::vector<WorkRange> &ranges, int thread_id,
+                           size_t &index);
+
+    void worker_loop(int thread_id);
+
+    int num_threads_;
+    std::vector<std::thread> workers_{};
+
+    std::mutex mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    const std::function<void(int)> *job_ = nullptr;
+    unsigned long generation_ = 0;
+    int pending_ = 0;
+    bool stop_ = false;
+    std::exception_ptr error_{};
+};
+
+#endif  // THREAD_POOL_H_
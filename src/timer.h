@@ -28,4 +28,30 @@ class Timer
     }
 };
 
+// polled from a driver loop, elapsed() is true at most once per period of
+// wall time, for work too slow to do every iteration like checking for
+// interrupts or redrawing progress
+template <typename ClockT = std::chrono::steady_clock>
+class Interval
+{
+   private:
+    using timep_t = typename ClockT::time_point;
+    typename ClockT::duration period_;
+    timep_t last_ = ClockT::now();
+
+   public:
+    explicit Interval(std::chrono::milliseconds period) : period_(period) {}
+
+    bool elapsed()
+    {
+        const timep_t now = ClockT::now();
+        if (now - last_ < period_)
+        {
+            return false;
+        }
+        last_ = now;
+        return true;
+    }
+};
+
 #endif /* TIMER_H */
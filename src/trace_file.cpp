@@ -0,0 +1,141 @@
+#include "trace_file.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+
+FileTraceSink::FileTraceSink(const GenotypingData &genotyping_data,
+                             const std::string &path, bool compress)
+    : path_(path),
+      compress_(compress),
+      out_(path, std::ios::binary | std::ios::trunc),
+      num_loci_(genotyping_data.num_loci),
+      num_samples_(genotyping_data.num_samples),
+      total_alleles_(0)
+{
+    if (!out_)
+    {
+        throw std::runtime_error("Unable to open trace file " + path);
+    }
+
+    const int32_t header[4] = {version, (int32_t)num_loci_,
+                               (int32_t)num_samples_, compress ? 1 : 0};
+    write("MOIRETRC", 8);
+    write(header, sizeof(header));
+    for (const auto &num_alleles : genotyping_data.num_alleles)
+    {
+        const int32_t k = num_alleles;
+        write(&k, sizeof(k));
+        total_alleles_ += num_alleles;
+    }
+
+    llik_.resize(chunk_draws);
+    mean_coi_.resize(chunk_draws);
+    coi_.resize(num_samples_ * chunk_draws);
+    eps_neg_.resize(num_samples_ * chunk_draws);
+    eps_pos_.resize(num_samples_ * chunk_draws);
+    allele_freqs_.resize(total_alleles_ * chunk_draws);
+}
+
+void FileTraceSink::record(const Chain &chain)
+{
+    llik_[draws_] = chain.get_llik();
+    mean_coi_[draws_] = chain.mean_coi;
+    for (size_t i = 0; i < num_samples_; i++)
+    {
+        coi_[i * chunk_draws + draws_] = chain.m[i];
+        eps_neg_[i * chunk_draws + draws_] = chain.eps_neg[i];
+        eps_pos_[i * chunk_draws + draws_] = chain.eps_pos[i];
+    }
+
+    size_t column = 0;
+    for (const auto &locus_freqs : chain.p)
+    {
+        for (const auto &freq : locus_freqs)
+        {
+            allele_freqs_[column++ * chunk_draws + draws_] = freq;
+        }
+    }
+
+    if (++draws_ == chunk_draws)
+    {
+        write_chunk();
+    }
+}
+
+void FileTraceSink::finish()
+{
+    if (draws_ > 0)
+    {
+        write_chunk();
+    }
+    out_.close();
+    if (!out_)
+    {
+        throw std::runtime_error("Unable to write trace file " + path_);
+    }
+}
+
+void FileTraceSink::collect(Rcpp::List &res,
+                            Rcpp::StringVector &res_names) const
+{
+    res.push_back(Rcpp::wrap(path_));
+    res_names.push_back("trace_file");
+}
+
+// first draws_ values of each column, columns being chunk_draws apart
+template <typename T>
+void FileTraceSink::append_columns(const std::vector<T> &columns)
+{
+    const size_t column_bytes = draws_ * sizeof(T);
+    for (size_t c = 0; c < columns.size(); c += chunk_draws)
+    {
+        const size_t offset = raw_.size();
+        raw_.resize(offset + column_bytes);
+        std::memcpy(raw_.data() + offset, columns.data() + c, column_bytes);
+    }
+}
+
+void FileTraceSink::write_chunk()
+{
+    raw_.clear();
+    append_columns(llik_);
+    append_columns(mean_coi_);
+    append_columns(coi_);
+    append_columns(eps_neg_);
+    append_columns(eps_pos_);
+    append_columns(allele_freqs_);
+
+    const char *payload = raw_.data();
+    size_t payload_bytes = raw_.size();
+    if (compress_)
+    {
+        uLongf compressed_bytes = compressBound(raw_.size());
+        compressed_.resize(compressed_bytes);
+        if (compress2(compressed_.data(), &compressed_bytes,
+                      reinterpret_cast<const Bytef *>(raw_.data()),
+                      raw_.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+        {
+            throw std::runtime_error("Unable to compress trace file " + path_);
+        }
+        payload = reinterpret_cast<const char *>(compressed_.data());
+        payload_bytes = compressed_bytes;
+    }
+
+    const int32_t chunk_header[2] = {draws_, 0};
+    const double sizes[2] = {(double)payload_bytes, (double)raw_.size()};
+    write(chunk_header, sizeof(chunk_header));
+    write(sizes, sizeof(sizes));
+    write(payload, payload_bytes);
+
+    draws_ = 0;
+}
+
+void FileTraceSink::write(const void *data, size_t bytes)
+{
+    out_.write(static_cast<const char *>(data), bytes);
+    if (!out_)
+    {
+        throw std::runtime_error("Unable to write trace file " + path_);
+    }
+}
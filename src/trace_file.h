@@ -0,0 +1,75 @@
+#pragma once
+
+#ifndef TRACE_FILE_H_
+#define TRACE_FILE_H_
+
+#include "trace_sink.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ * Streams draws to a columnar binary file, keeping only the current chunk in
+ * memory. All values are native endian.
+ *
+ * Header:
+ *   char[8] "MOIRETRC", int32 version, int32 num_loci, int32 num_samples,
+ *   int32 compressed, int32 num_alleles[num_loci]
+ *
+ * Then one block per chunk of up to chunk_draws draws:
+ *   int32 num_draws, int32 0, double payload_bytes, double raw_bytes,
+ *   payload
+ *
+ * The payload, zlib compressed if the file is, holds the chunk's draws one
+ * column at a time, each column holding num_draws values:
+ *   llik (double), mean_coi (double), coi of each sample (int32), eps_neg
+ *   of each sample (double), eps_pos of each sample (double), then the
+ *   frequency of each allele of each locus (double)
+ *
+ * so any single column of an uncompressed file can be read by seeking.
+ */
+class FileTraceSink : public TraceSink
+{
+   public:
+    static constexpr int32_t version = 1;
+    static constexpr int chunk_draws = 256;
+
+    FileTraceSink(const GenotypingData &genotyping_data,
+                  const std::string &path, bool compress);
+
+    void record(const Chain &chain) override;
+    void finish() override;
+    void collect(Rcpp::List &res,
+                 Rcpp::StringVector &res_names) const override;
+
+   private:
+    std::string path_;
+    bool compress_;
+    std::ofstream out_;
+
+    size_t num_loci_;
+    size_t num_samples_;
+    size_t total_alleles_;
+
+    // columns of the current chunk, column c holding values
+    // [c * chunk_draws, c * chunk_draws + draws_)
+    int draws_ = 0;
+    std::vector<double> llik_{};
+    std::vector<double> mean_coi_{};
+    std::vector<int32_t> coi_{};
+    std::vector<double> eps_neg_{};
+    std::vector<double> eps_pos_{};
+    std::vector<double> allele_freqs_{};
+
+    std::vector<char> raw_{};
+    std::vector<unsigned char> compressed_{};
+
+    template <typename T>
+    void append_columns(const std::vector<T> &columns);
+    void write_chunk();
+    void write(const void *data, size_t bytes);
+};
+
+#endif  // TRACE_FILE_H_
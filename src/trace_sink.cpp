@@ -0,0 +1,107 @@
+#include "trace_sink.h"
+
+#include <algorithm>
+
+namespace
+{
+// first nrow rows of a matrix, only copied when a run stopped early and
+// left rows unfilled
+template <typename Matrix>
+Matrix head_rows(const Matrix &values, int nrow)
+{
+    if (nrow == values.nrow())
+    {
+        return values;
+    }
+
+    Matrix res(nrow, values.ncol());
+    auto out = res.begin();
+    for (int c = 0; c < values.ncol(); c++)
+    {
+        const auto column = values.begin() + (size_t)c * values.nrow();
+        out = std::copy(column, column + nrow, out);
+    }
+    return res;
+}
+
+Rcpp::NumericVector head(const Rcpp::NumericVector &values, int n)
+{
+    if (n == (int)values.size())
+    {
+        return values;
+    }
+    Rcpp::NumericVector res(n);
+    std::copy(values.begin(), values.begin() + n, res.begin());
+    return res;
+}
+}  // namespace
+
+MemoryTraceSink::MemoryTraceSink(const GenotypingData &genotyping_data,
+                                 int num_draws)
+    : num_draws(num_draws),
+      m_store(num_draws, genotyping_data.num_samples),
+      eps_pos_store(num_draws, genotyping_data.num_samples),
+      eps_neg_store(num_draws, genotyping_data.num_samples),
+      mean_coi_store(num_draws),
+      llik_sample(num_draws),
+      num_samples_(genotyping_data.num_samples),
+      num_alleles_(genotyping_data.num_alleles),
+      m_data_(m_store.begin()),
+      eps_pos_data_(eps_pos_store.begin()),
+      eps_neg_data_(eps_neg_store.begin()),
+      mean_coi_data_(mean_coi_store.begin()),
+      llik_data_(llik_sample.begin())
+{
+    p_store.reserve(genotyping_data.num_loci);
+    p_data_.reserve(genotyping_data.num_loci);
+    for (size_t j = 0; j < genotyping_data.num_loci; ++j)
+    {
+        p_store.emplace_back(num_draws, num_alleles_[j]);
+        p_data_.push_back(p_store.back().begin());
+    }
+}
+
+void MemoryTraceSink::record(const Chain &chain)
+{
+    for (size_t j = 0; j < p_data_.size(); ++j)
+    {
+        for (int k = 0; k < num_alleles_[j]; ++k)
+        {
+            p_data_[j][k * num_draws + draws] = chain.p[j][k];
+        }
+    }
+
+    for (size_t i = 0; i < num_samples_; ++i)
+    {
+        m_data_[i * num_draws + draws] = chain.m[i];
+        eps_neg_data_[i * num_draws + draws] = chain.eps_neg[i];
+        eps_pos_data_[i * num_draws + draws] = chain.eps_pos[i];
+    }
+    mean_coi_data_[draws] = chain.mean_coi;
+    llik_data_[draws] = chain.get_llik();
+    draws++;
+}
+
+void MemoryTraceSink::collect(Rcpp::List &res,
+                              Rcpp::StringVector &res_names) const
+{
+    Rcpp::List allele_freqs;
+    for (const auto &p : p_store)
+    {
+        allele_freqs.push_back(head_rows(p, draws));
+    }
+
+    res.push_back(head(llik_sample, draws));
+    res.push_back(head_rows(m_store, draws));
+    res.push_back(allele_freqs);
+    res.push_back(head_rows(eps_neg_store, draws));
+    res.push_back(head_rows(eps_pos_store, draws));
+    res.push_back(head(mean_coi_store, draws));
+
+    res_names.push_back("llik_sample");
+    res_names.push_back("coi");
+    res_names.push_back("allele_freqs");
+    res_names.push_back("eps_neg");
+    res_names.push_back("eps_pos");
+    res_names.push_back("mean_coi");
+}
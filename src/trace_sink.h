@@ -0,0 +1,80 @@
+#pragma once
+
+#ifndef TRACE_SINK_H_
+#define TRACE_SINK_H_
+
+#include "chain.h"
+
+#include <Rcpp.h>
+#include <vector>
+
+/*
+ * Destination of the draws retained from one rung of the temperature ladder.
+ * record() is called from the thread running the chain and must not call
+ * into R; results are only collected once the run is over.
+ */
+class TraceSink
+{
+   public:
+    virtual ~TraceSink() = default;
+
+    void record_burnin(const Chain &chain)
+    {
+        llik_burnin.push_back(chain.get_llik());
+    }
+
+    // one retained draw of chain
+    virtual void record(const Chain &chain) = 0;
+
+    // called once after the last draw
+    virtual void finish() {}
+
+    // append the trace to the chain's results
+    virtual void collect(Rcpp::List &res,
+                         Rcpp::StringVector &res_names) const = 0;
+
+    std::vector<double> llik_burnin{};
+};
+
+/*
+ * Keeps every draw in memory, in the R matrices returned to the caller. They
+ * are allocated for num_draws draws when the sink is built on the R thread,
+ * and record() only writes through their data pointers, so no R API is
+ * called while the run is going and the trace is never copied.
+ */
+class MemoryTraceSink : public TraceSink
+{
+   public:
+    MemoryTraceSink(const GenotypingData &genotyping_data, int num_draws);
+
+    void record(const Chain &chain) override;
+    void collect(Rcpp::List &res,
+                 Rcpp::StringVector &res_names) const override;
+
+    // capacity, and draws recorded which is fewer if sampling stopped early
+    int num_draws;
+    int draws = 0;
+
+    // draws by samples, or draws by alleles of a locus
+    Rcpp::IntegerMatrix m_store{};
+    std::vector<Rcpp::NumericMatrix> p_store{};
+    Rcpp::NumericMatrix eps_pos_store{};
+    Rcpp::NumericMatrix eps_neg_store{};
+    Rcpp::NumericVector mean_coi_store{};
+    Rcpp::NumericVector llik_sample{};
+
+   private:
+    size_t num_samples_;
+    std::vector<int> num_alleles_{};
+
+    // data of the R objects above, element (d, i) of a matrix is at
+    // [i * num_draws + d]
+    int *m_data_;
+    std::vector<double *> p_data_{};
+    double *eps_pos_data_;
+    double *eps_neg_data_;
+    double *mean_coi_data_;
+    double *llik_data_;
+};
+
+#endif  // TRACE_SINK_H_
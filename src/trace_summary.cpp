@@ -0,0 +1,104 @@
+#include "trace_summary.h"
+
+namespace
+{
+// list of the mean, variance and quantiles of each of summaries
+Rcpp::List collect_summaries(const std::vector<RunningSummary> &summaries,
+                             size_t num_quantiles)
+{
+    Rcpp::NumericVector mean(summaries.size());
+    Rcpp::NumericVector variance(summaries.size());
+    Rcpp::NumericMatrix quantiles(summaries.size(), num_quantiles);
+    for (size_t k = 0; k < summaries.size(); k++)
+    {
+        mean[k] = summaries[k].mean();
+        variance[k] = summaries[k].variance();
+        for (size_t q = 0; q < num_quantiles; q++)
+        {
+            quantiles(k, q) = summaries[k].quantile(q);
+        }
+    }
+
+    return Rcpp::List::create(Rcpp::Named("mean") = mean,
+                              Rcpp::Named("variance") = variance,
+                              Rcpp::Named("quantiles") = quantiles);
+}
+}  // namespace
+
+SummaryTraceSink::SummaryTraceSink(const GenotypingData &genotyping_data,
+                                   const std::vector<double> &probs)
+    : probs_(probs)
+{
+    const RunningSummary empty(probs);
+
+    coi_counts_.resize(genotyping_data.num_samples);
+    eps_neg_.resize(genotyping_data.num_samples, empty);
+    eps_pos_.resize(genotyping_data.num_samples, empty);
+    he_.resize(genotyping_data.num_loci, empty);
+    for (const auto &num_alleles : genotyping_data.num_alleles)
+    {
+        allele_freqs_.emplace_back(num_alleles, empty);
+    }
+}
+
+void SummaryTraceSink::record(const Chain &chain)
+{
+    num_draws_++;
+
+    for (size_t i = 0; i < coi_counts_.size(); i++)
+    {
+        auto &counts = coi_counts_[i];
+        if ((int)counts.size() < chain.m[i])
+        {
+            counts.resize(chain.m[i], 0);
+        }
+        counts[chain.m[i] - 1]++;
+
+        eps_neg_[i].add(chain.eps_neg[i]);
+        eps_pos_[i].add(chain.eps_pos[i]);
+    }
+
+    for (size_t j = 0; j < allele_freqs_.size(); j++)
+    {
+        double sum_sq = 0;
+        for (size_t k = 0; k < allele_freqs_[j].size(); k++)
+        {
+            const double freq = chain.p[j][k];
+            allele_freqs_[j][k].add(freq);
+            sum_sq += freq * freq;
+        }
+        he_[j].add(1 - sum_sq);
+    }
+
+    mean_coi_.push_back(chain.mean_coi);
+    llik_sample_.push_back(chain.get_llik());
+}
+
+void SummaryTraceSink::collect(Rcpp::List &res,
+                               Rcpp::StringVector &res_names) const
+{
+    const size_t num_quantiles = probs_.size();
+
+    Rcpp::List allele_freqs;
+    for (const auto &locus : allele_freqs_)
+    {
+        allele_freqs.push_back(collect_summaries(locus, num_quantiles));
+    }
+
+    Rcpp::List summary = Rcpp::List::create(
+        Rcpp::Named("num_draws") = num_draws_,
+        Rcpp::Named("quantiles") = Rcpp::wrap(probs_),
+        Rcpp::Named("coi") = Rcpp::wrap(coi_counts_),
+        Rcpp::Named("allele_freqs") = allele_freqs,
+        Rcpp::Named("he") = collect_summaries(he_, num_quantiles),
+        Rcpp::Named("eps_neg") = collect_summaries(eps_neg_, num_quantiles),
+        Rcpp::Named("eps_pos") = collect_summaries(eps_pos_, num_quantiles));
+
+    res.push_back(Rcpp::wrap(llik_sample_));
+    res.push_back(Rcpp::wrap(mean_coi_));
+    res.push_back(summary);
+
+    res_names.push_back("llik_sample");
+    res_names.push_back("mean_coi");
+    res_names.push_back("summary");
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#ifndef TRACE_SUMMARY_H_
+#define TRACE_SUMMARY_H_
+
+#include "running_summary.h"
+#include "trace_sink.h"
+
+#include <vector>
+
+/*
+ * Keeps streaming summaries of the draws in place of the draws themselves:
+ * a histogram of each sample's COI, and the mean, variance and quantiles of
+ * each allele frequency, each locus' expected heterozygosity and each
+ * sample's error rates. Only the scalar llik and mean_coi traces are kept
+ * in full, so memory no longer grows with the number of samples.
+ */
+class SummaryTraceSink : public TraceSink
+{
+   public:
+    SummaryTraceSink(const GenotypingData &genotyping_data,
+                     const std::vector<double> &probs);
+
+    void record(const Chain &chain) override;
+    void collect(Rcpp::List &res,
+                 Rcpp::StringVector &res_names) const override;
+
+   private:
+    std::vector<double> probs_;
+    int num_draws_ = 0;
+
+    // coi_counts_[i][c - 1] draws of sample i with COI c
+    std::vector<std::vector<int>> coi_counts_{};
+    std::vector<std::vector<RunningSummary>> allele_freqs_{};
+    std::vector<RunningSummary> he_{};
+    std::vector<RunningSummary> eps_neg_{};
+    std::vector<RunningSummary> eps_pos_{};
+
+    std::vector<double> mean_coi_{};
+    std::vector<double> llik_sample_{};
+};
+
+#endif  // TRACE_SUMMARY_H_
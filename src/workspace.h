@@ -0,0 +1,113 @@
+#pragma once
+
+#ifndef WORKSPACE_H_
+#define WORKSPACE_H_
+
+#include "allele_set.h"
+#include "halton_sequence.h"
+#include "latent_memo.h"
+#include "lookup.h"
+#include "prob_any_missing.h"
+#include "profile.h"
+#include "revolving_door_generator.h"
+#include "sampler.h"
+
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+// Inputs that fully determine a sample's marginal likelihood at a locus
+struct PatternKey
+{
+    int pattern;
+    int coi;
+    double epsilon_neg;
+    double epsilon_pos;
+
+    bool operator==(const PatternKey &other) const
+    {
+        return pattern == other.pattern && coi == other.coi &&
+               epsilon_neg == other.epsilon_neg &&
+               epsilon_pos == other.epsilon_pos;
+    }
+};
+
+struct PatternKeyHash
+{
+    size_t operator()(const PatternKey &key) const
+    {
+        uint64_t neg;
+        uint64_t pos;
+        std::memcpy(&neg, &key.epsilon_neg, sizeof(neg));
+        std::memcpy(&pos, &key.epsilon_pos, sizeof(pos));
+
+        size_t h = std::hash<uint64_t>()(
+            ((uint64_t)(uint32_t)key.pattern << 32) | (uint32_t)key.coi);
+        h ^= std::hash<uint64_t>()(neg) + 0x9e3779b97f4a7c15ULL + (h << 6) +
+             (h >> 2);
+        h ^= std::hash<uint64_t>()(pos) + 0x9e3779b97f4a7c15ULL + (h << 6) +
+             (h >> 2);
+        return h;
+    }
+};
+
+/*
+ * Mutable state needed to evaluate the likelihood kernels. Each thread
+ * working on a chain owns one, so kernels never share scratch buffers or
+ * random number streams.
+ */
+struct Workspace
+{
+    explicit Workspace(const Lookup &lookup) : sampler(lookup){};
+
+    Sampler sampler;
+    probAnyMissingFunctor probAnyMissing{};
+    RevolvingDoorGenerator allele_index_generator{};
+
+    std::vector<double> prVec{};
+    std::vector<int> prSlot{};
+    // latent genotype proposed by data augmentation moves
+    std::vector<int> latentProposal{};
+    std::vector<long double> dpVec{};
+    std::vector<long double> dpPow{};
+
+    // importance sampling scratch
+    std::vector<double> reweightedFreqs{};
+    std::vector<int> latentIndices{};
+    std::vector<AlleleSet::word_t> latentKey{};
+    LatentMemo latent_memo{};
+    HaltonSequence halton{};
+
+    // relative standard errors of the importance sampled marginals
+    double is_error_sum = 0;
+    long is_error_calls = 0;
+
+    // proposed marginals of every sample at the locus being updated
+    std::vector<double> locusLlik{};
+
+    // batched marginals over several COIs
+    std::vector<int> enumCois{};
+    std::vector<double> enumLliks{};
+    std::vector<long double> enumSums{};
+    std::vector<double> drawnProbs{};
+    std::vector<int> uncachedCois{};
+    std::vector<double> uncachedLliks{};
+    std::vector<double> locusLliks{};
+
+    // multiple-try COI moves, see Chain::score_coi_tries
+    std::vector<int> coiTries{};
+    std::vector<double> tryScores{};
+    std::vector<size_t> tryCandidates{};
+    std::vector<int> coiCandidates{};
+    std::vector<double> candidateMarginals{};
+    std::vector<double> candidateScores{};
+
+    // marginal likelihoods already computed for the locus being updated
+    std::unordered_map<PatternKey, double, PatternKeyHash> pattern_memo{};
+
+    // marginals and lookups of this thread when profiling
+    Profile profile{};
+};
+
+#endif  // WORKSPACE_H_